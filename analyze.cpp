@@ -0,0 +1,281 @@
+// Annotate played games, or positions, with their values from the solved
+// table of a rule variant, streaming from a file (or stdin) to a file (or
+// stdout). Input is read in batches, each replayed and evaluated by all
+// threads at once through the batched lookup, so memory stays bounded however
+// long the input.
+//
+// Text input has one game per line, as the moves entered in play from the
+// initial board: "<start> <end> <start> <end> ...". Each line of output has
+// "<value> <moves>" for each position of the game, from the initial board to
+// the last move, for the player to move, as in server.cpp (or "error" and the
+// reason, e.g. an illegal move).
+//
+// With --binary, input is game states (8 bytes each, in native byte order)
+// with the player to move as player 1, and output is the table entry for
+// each: the state with its value packed into the upper 10 bits, as by
+// Game::pack() (or 0, if the state is invalid or was not reached).
+
+#include "gobblet.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Games (lines of text) or states read and processed at a time.
+const std::size_t TEXT_BATCH = 1 << 16;
+const std::size_t BINARY_BATCH = 1 << 20;
+
+// Run f(thread, begin, end) on each thread's share of n items.
+template<typename F>
+void split(int num_threads, std::size_t n, F f)
+{
+    std::vector<std::thread> threads;
+    for (int thread = 0; thread < num_threads; ++thread)
+    {
+        threads.emplace_back(f, thread, n * thread / num_threads,
+            n * (thread + 1) / num_threads);
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+}
+
+// Read line (without its newline) from file, returning false at its end.
+bool read_line(std::FILE* in, std::string& line)
+{
+    line.clear();
+    char buffer[256];
+    while (std::fgets(buffer, sizeof(buffer), in) != nullptr)
+    {
+        line += buffer;
+        if (line.back() == '\n')
+        {
+            line.pop_back();
+            return true;
+        }
+    }
+    return !line.empty();
+}
+
+// Replay games in lines [begin, end), writing their annotations to out, and
+// return the number of positions evaluated.
+template<typename G>
+std::size_t annotate(G& game, const std::vector<std::string>& lines,
+    std::size_t begin, std::size_t end, std::vector<std::string>& out)
+{
+    // Collect the positions of all these games, with the number in each (or
+    // 0 if it is invalid), then evaluate them at once.
+    std::vector<State> states;
+    std::vector<std::size_t> counts;
+    std::vector<int> moves;
+    for (std::size_t i = begin; i < end; ++i)
+    {
+        std::istringstream in(lines[i]);
+        moves.clear();
+        for (int x = 0; in >> x;)
+        {
+            moves.push_back(x);
+        }
+        std::size_t first = states.size();
+        State s = 0;
+        states.push_back(s);
+        for (std::size_t j = 0; j + 1 < moves.size(); j += 2)
+        {
+            Move m{moves[j], moves[j + 1]};
+            if (!game.is_legal(s, m))
+            {
+                out[i] = "error illegal move " + std::to_string(j / 2 + 1);
+                break;
+            }
+            s = game.swap(game.move(s, m));
+            states.push_back(s);
+        }
+        if (out[i].empty() && (!in.eof() || moves.size() % 2 != 0))
+        {
+            out[i] = "error expected moves";
+        }
+        if (!out[i].empty())
+        {
+            states.resize(first);
+        }
+        counts.push_back(states.size() - first);
+    }
+    std::vector<Evaluation> evals(states.size());
+    game.evaluate(states.data(), states.size(), evals.data());
+
+    const Evaluation* eval = evals.data();
+    for (std::size_t i = begin; i < end; eval += counts[i - begin], ++i)
+    {
+        for (std::size_t j = 0; j < counts[i - begin]; ++j)
+        {
+            if (!eval[j].found)
+            {
+                out[i] = "error unreachable position " + std::to_string(j);
+                break;
+            }
+            out[i] += (j == 0 ? "" : " ") + std::to_string(eval[j].value) +
+                " " + std::to_string(eval[j].moves);
+        }
+    }
+    return states.size();
+}
+
+// Annotate states in [begin, end) with their table entries, in place.
+template<typename G>
+void annotate(G& game, State* states, std::size_t begin, std::size_t end)
+{
+    const std::size_t BATCH = 1024;
+    Evaluation evals[BATCH];
+    bool valid[BATCH];
+    for (std::size_t i = begin; i < end; i += BATCH)
+    {
+        std::size_t n = std::min(BATCH, end - i);
+        State* s = states + i;
+        for (std::size_t j = 0; j < n; ++j)
+        {
+            valid[j] = game.is_valid(s[j]);
+            s[j] = valid[j] ? s[j] : 0;
+        }
+        game.evaluate(s, n, evals);
+        for (std::size_t j = 0; j < n; ++j)
+        {
+            s[j] = valid[j] && evals[j].found ?
+                s[j] | game.pack(evals[j].value, evals[j].moves) : 0;
+        }
+    }
+}
+
+// Annotate input from in to out with given solved game, returning exit status.
+template<typename G>
+int analyze(G& game, bool binary, std::FILE* in, std::FILE* out)
+{
+    int num_threads = std::max(1u, std::thread::hardware_concurrency());
+    auto start = std::chrono::steady_clock::now();
+    std::size_t count = 0;
+    bool ok = true;
+    if (binary)
+    {
+        std::vector<State> states(BINARY_BATCH);
+        std::size_t n = 0;
+        while (ok && (n = std::fread(states.data(), sizeof(State),
+            states.size(), in)) > 0)
+        {
+            split(num_threads, n, [&](int, std::size_t begin, std::size_t end)
+            {
+                annotate(game, states.data(), begin, end);
+            });
+            ok = std::fwrite(states.data(), sizeof(State), n, out) == n;
+            count += n;
+        }
+    }
+    else
+    {
+        std::vector<std::string> lines(TEXT_BATCH);
+        std::vector<std::string> results(TEXT_BATCH);
+        std::vector<std::size_t> counts(num_threads);
+        std::string text;
+        std::size_t n = 0;
+        do
+        {
+            for (n = 0; n < lines.size() && read_line(in, lines[n]); ++n)
+            {
+                results[n].clear();
+            }
+            split(num_threads, n, [&](int thread, std::size_t begin,
+                std::size_t end)
+            {
+                counts[thread] = annotate(game, lines, begin, end, results);
+            });
+            text.clear();
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                text += results[i];
+                text += '\n';
+            }
+            for (std::size_t c : counts)
+            {
+                count += c;
+            }
+            ok = std::fwrite(text.data(), 1, text.size(), out) == text.size();
+        }
+        while (ok && n == lines.size());
+    }
+    ok = ok && !std::ferror(in) && std::fflush(out) == 0;
+    double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    std::cerr << "Analyzed " << count << " positions in " << seconds <<
+        " s." << std::endl;
+    if (!ok)
+    {
+        std::cerr << "Failed to read input or write output." << std::endl;
+    }
+    return ok ? 0 : 1;
+}
+
+int main(int argc, char** argv)
+{
+    bool binary = false;
+    std::vector<std::string> args;
+    for (int arg = 1; arg < argc; ++arg)
+    {
+        if (std::strcmp(argv[arg], "--binary") == 0)
+        {
+            binary = true;
+        }
+        else
+        {
+            args.push_back(argv[arg]);
+        }
+    }
+    if (args.size() < 3 || args.size() > 5)
+    {
+        std::cerr << "Usage: " << argv[0] << " [--binary] num_sizes " <<
+            "num_per_size allow_move [input [output]]" << std::endl;
+        return 1;
+    }
+    int num_sizes = std::atoi(args[0].c_str());
+    int num_per_size = std::atoi(args[1].c_str());
+    bool allow_move = std::atoi(args[2].c_str()) != 0;
+    if (num_sizes < 1 || num_sizes > 3 ||
+        num_per_size < 1 || num_per_size > (num_sizes < 3 ? 9 : 2))
+    {
+        std::cerr << "Rule variant not supported." << std::endl;
+        return 1;
+    }
+
+    // Every variant accepted above is specialized (see for_each_fixed_game()).
+    int status = 1;
+    for_each_fixed_game([&]<typename G>(const Variant& rules)
+    {
+        if (rules.num_sizes == num_sizes &&
+            rules.num_per_size == num_per_size &&
+            rules.allow_move == allow_move)
+        {
+            G game{num_sizes, num_per_size, allow_move, &std::cerr};
+            if (!game.has_table())
+            {
+                std::cerr << "Failed to solve rule variant." << std::endl;
+                return;
+            }
+            std::FILE* in = args.size() > 3 && args[3] != "-" ?
+                std::fopen(args[3].c_str(), "rb") : stdin;
+            std::FILE* out = args.size() > 4 && args[4] != "-" ?
+                std::fopen(args[4].c_str(), "wb") : stdout;
+            if (in == nullptr || out == nullptr)
+            {
+                std::cerr << "Failed to open input or output file." <<
+                    std::endl;
+                return;
+            }
+            status = analyze(game, binary, in, out);
+        }
+    });
+    return status;
+}
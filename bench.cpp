@@ -0,0 +1,399 @@
+// Benchmarks of the solver, timing search and solve for each rule variant,
+// and of the game state operations and table lookups it is built on, using
+// a sample of states reached by random play. Each is timed both for the game
+// specialized for the variant at compile time (FixedGame, as in play) and
+// for the runtime-configured Game, in consecutive rows. Results are written
+// as CSV, or as JSON with --json; the exit status is nonzero if a hashed
+// table or the symmetries of a sample state fail their checks.
+
+#include "gobblet.h"
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct Result
+{
+    std::string variant;
+    std::string game; // "fixed" or "runtime"
+    std::string benchmark;
+    std::size_t count; // operations, or states found or solved
+    double seconds;
+};
+
+// Keep results of benchmarked operations live.
+volatile State sink = 0;
+
+// Set if a hashed table differs from the ranked one, or the symmetries
+// found by canonical() don't map states and moves consistently.
+bool failed = false;
+
+// Time f(i) for each of n sample indices, repeating for at least 0.1 s.
+template<typename F>
+Result time_ops(const std::string& variant, const std::string& benchmark,
+    std::size_t n, F f)
+{
+    auto start = std::chrono::steady_clock::now();
+    std::size_t count = 0;
+    double seconds = 0;
+    State result = 0;
+    while (seconds < 0.1)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            result ^= f(i);
+        }
+        count += n;
+        seconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+    }
+    sink = sink ^ result;
+    return Result{variant, "", benchmark, count, seconds};
+}
+
+// Return sample of (non-canonical) states reached by random play from the
+// initial board, with a random move from each.
+template<typename G>
+std::vector<std::pair<State, Move> > sample_states(G& game, std::size_t n)
+{
+    std::mt19937_64 rng(1);
+    std::vector<std::pair<State, Move> > sample;
+    while (sample.size() < n)
+    {
+        State s = 0;
+        for (int ply = 0; ply < 40 && sample.size() < n; ++ply)
+        {
+            Moves moves = game.get_moves(s);
+            if (game.get_terminal_value(s) != 0 || moves.size() == 0)
+            {
+                break;
+            }
+            Move m = moves[rng() % moves.size()];
+            sample.push_back({s, m});
+            s = game.swap(game.move(s, m));
+        }
+    }
+    return sample;
+}
+
+// Return number of sample states for which canonical(s, symmetry) is not
+// canonical(s) or the image of s under that symmetry, or the sample move,
+// mapped to the canonical board with transform(), does not lead to the image
+// of the state it leads to, or untransform() does not map it back, as the
+// server relies on.
+template<typename G>
+std::size_t check_symmetries(G& game,
+    const std::vector<std::pair<State, Move> >& sample)
+{
+    std::size_t bad = 0;
+    for (auto& p : sample)
+    {
+        int symmetry = 0;
+        State c = game.canonical(p.first, symmetry);
+        Move m = game.transform(p.second, symmetry);
+        Move back = game.untransform(m, symmetry);
+        bad += c == game.canonical(p.first) &&
+            c == game.transform(p.first, symmetry) &&
+            game.move(c, m) == game.transform(game.move(p.first, p.second),
+            symmetry) && back.start == p.second.start &&
+            back.end == p.second.end ? 0 : 1;
+    }
+    return bad;
+}
+
+// Return number of sample moves that end the game for which best_move() of
+// the resulting state is not 0 0, or all_move_values() is not empty, as the
+// server promises.
+template<typename G>
+std::size_t check_game_over(G& game,
+    const std::vector<std::pair<State, Move> >& sample)
+{
+    std::size_t bad = 0;
+    for (auto& p : sample)
+    {
+        State s = game.swap(game.move(p.first, p.second));
+        if (game.get_terminal_value(s) != 0)
+        {
+            Move m = game.best_move(game.canonical(s));
+            bad += m.start == 0 && m.end == 0 &&
+                game.all_move_values(game.canonical(s)).empty() ? 0 : 1;
+        }
+    }
+    return bad;
+}
+
+// Solve game for given rules in memory, then time operations on a sample of
+// its states.
+template<typename G>
+void run(const Variant& rules, const std::string& name,
+    std::vector<Result>& results)
+{
+    std::string variant = std::to_string(rules.num_sizes) + "_" +
+        std::to_string(rules.num_per_size) + "_" +
+        std::to_string(rules.allow_move);
+    std::cerr << "Benchmarking " << variant << " (" << name << ")..." <<
+        std::endl;
+    G game;
+    if (!game.solve(rules))
+    {
+        std::cerr << "Table for " << variant << " does not fit in memory." <<
+            std::endl;
+        return;
+    }
+    const SolveStats& stats = game.stats();
+    results.push_back(Result{variant, name, "search", stats.num_states,
+        stats.search_seconds});
+    results.push_back(Result{variant, name, "solve", stats.num_solved,
+        stats.solve_seconds});
+
+    // Solve again with a hash map instead, if it fits, starting small so
+    // that it grows during the search, and check it against the table, and
+    // the table against it.
+    G hashed(&std::cerr);
+    std::size_t slots = std::bit_ceil(2 * stats.num_states);
+    bool fits = slots * sizeof(State) <= hashed.memory_limit();
+    hashed.set_hashed(true);
+    if (fits && hashed.solve(rules))
+    {
+        const SolveStats& hashed_stats = hashed.stats();
+        results.push_back(Result{variant, name, "search_hashed",
+            hashed_stats.num_states, hashed_stats.search_seconds});
+        results.push_back(Result{variant, name, "solve_hashed",
+            hashed_stats.num_solved, hashed_stats.solve_seconds});
+        if (hashed.compare(game) != 0 || game.compare(hashed) != 0)
+        {
+            std::cerr << "Hashed table for " << variant << " differs." <<
+                std::endl;
+            failed = true;
+        }
+    }
+    else
+    {
+        std::cerr << "Hash map for " << variant << " does not fit in " <<
+            "memory." << std::endl;
+    }
+
+    const std::size_t N = 1 << 14;
+    std::vector<std::pair<State, Move> > sample = sample_states(game, N);
+    std::vector<State> states;
+    for (auto& p : sample)
+    {
+        states.push_back(p.first);
+    }
+    if (check_symmetries(game, sample) != 0)
+    {
+        std::cerr << "Symmetries of " << variant << " are inconsistent." <<
+            std::endl;
+        failed = true;
+    }
+    if (check_game_over(game, sample) != 0)
+    {
+        std::cerr << "Moves are given from finished games of " << variant <<
+            "." << std::endl;
+        failed = true;
+    }
+    std::vector<State> keys(N);
+    std::vector<Evaluation> evaluations(N);
+    results.push_back(time_ops(variant, "canonical", N, [&](std::size_t i)
+    {
+        return game.canonical(states[i]);
+    }));
+    results.push_back(time_ops(variant, "canonical_symmetry", N,
+        [&](std::size_t i)
+    {
+        int symmetry = 0;
+        return game.canonical(states[i], symmetry) + State(symmetry);
+    }));
+    results.push_back(time_ops(variant, "canonical_batch", 1,
+        [&](std::size_t)
+    {
+        game.canonical(states.data(), N, keys.data());
+        return keys[N - 1];
+    }));
+    results.back().count *= N;
+    results.push_back(time_ops(variant, "swap", N, [&](std::size_t i)
+    {
+        return game.swap(states[i]);
+    }));
+    results.push_back(time_ops(variant, "move", N, [&](std::size_t i)
+    {
+        return game.move(sample[i].first, sample[i].second);
+    }));
+    results.push_back(time_ops(variant, "get_terminal_value", N,
+        [&](std::size_t i)
+    {
+        return State(game.get_terminal_value(states[i]));
+    }));
+    results.push_back(time_ops(variant, "get_moves", N, [&](std::size_t i)
+    {
+        return State(game.get_moves(states[i]).size());
+    }));
+    results.push_back(time_ops(variant, "get_moves_next", N,
+        [&](std::size_t i)
+    {
+        NextStates next;
+        game.get_moves(states[i], &next);
+        return next.size() > 0 ? next[0] : 0;
+    }));
+    results.push_back(time_ops(variant, "get_unmoves", N, [&](std::size_t i)
+    {
+        return State(game.get_unmoves(keys[i]).size());
+    }));
+    results.push_back(time_ops(variant, "evaluate", N, [&](std::size_t i)
+    {
+        return State(game.evaluate(states[i]).moves);
+    }));
+    results.push_back(time_ops(variant, "evaluate_batch", 1,
+        [&](std::size_t)
+    {
+        game.evaluate(states.data(), N, evaluations.data());
+        return State(evaluations[N - 1].moves);
+    }));
+    results.back().count *= N;
+    if (fits)
+    {
+        results.push_back(time_ops(variant, "evaluate_hashed", N,
+            [&](std::size_t i)
+        {
+            return State(hashed.evaluate(states[i]).moves);
+        }));
+        results.push_back(time_ops(variant, "evaluate_batch_hashed", 1,
+            [&](std::size_t)
+        {
+            hashed.evaluate(states.data(), N, evaluations.data());
+            return State(evaluations[N - 1].moves);
+        }));
+        results.back().count *= N;
+    }
+    results.push_back(time_ops(variant, "best_move", N, [&](std::size_t i)
+    {
+        Move m = game.best_move(states[i]);
+        return State(m.start * 9 + m.end);
+    }));
+    results.push_back(time_ops(variant, "all_move_values", N,
+        [&](std::size_t i)
+    {
+        return State(game.all_move_values(states[i]).size());
+    }));
+    results.push_back(time_ops(variant, "principal_variation", N,
+        [&](std::size_t i)
+    {
+        return State(game.principal_variation(states[i]).size());
+    }));
+    for (auto& result : results)
+    {
+        result.game = name;
+    }
+}
+
+// Run benchmarks for given rules with FixedGame G and then the runtime Game,
+// interleaving their results so that each row for G is followed by the same
+// benchmark for Game.
+template<typename G>
+void run_both(const Variant& rules, std::vector<Result>& results)
+{
+    std::vector<Result> fixed;
+    std::vector<Result> runtime;
+    run<G>(rules, "fixed", fixed);
+    run<Game>(rules, "runtime", runtime);
+    for (std::size_t i = 0; i < std::max(fixed.size(), runtime.size()); ++i)
+    {
+        if (i < fixed.size())
+        {
+            results.push_back(fixed[i]);
+        }
+        if (i < runtime.size())
+        {
+            results.push_back(runtime[i]);
+        }
+    }
+}
+
+void write_csv(const std::vector<Result>& results)
+{
+    std::printf("variant,game,benchmark,count,seconds,ns_per_op\n");
+    for (auto& r : results)
+    {
+        std::printf("%s,%s,%s,%zu,%.6f,%.3f\n", r.variant.c_str(),
+            r.game.c_str(), r.benchmark.c_str(), r.count, r.seconds,
+            1e9 * r.seconds / r.count);
+    }
+}
+
+void write_json(const std::vector<Result>& results)
+{
+    std::printf("[\n");
+    for (std::size_t i = 0; i < results.size(); ++i)
+    {
+        const Result& r = results[i];
+        std::printf("  {\"variant\": \"%s\", \"game\": \"%s\", "
+            "\"benchmark\": \"%s\", \"count\": %zu, \"seconds\": %.6f, "
+            "\"ns_per_op\": %.3f}%s\n", r.variant.c_str(), r.game.c_str(),
+            r.benchmark.c_str(), r.count, r.seconds, 1e9 * r.seconds / r.count,
+            i + 1 < results.size() ? "," : "");
+    }
+    std::printf("]\n");
+}
+
+int main(int argc, char** argv)
+{
+    // By default, run the variants that solve in a few seconds.
+    bool json = false;
+    std::vector<std::string> names;
+    for (int arg = 1; arg < argc; ++arg)
+    {
+        std::string name = argv[arg];
+        if (name == "--json")
+        {
+            json = true;
+        }
+        else
+        {
+            names.push_back(name);
+        }
+    }
+    if (names.empty())
+    {
+        names = {"1_3_0", "1_3_1", "2_2_0", "2_2_1", "3_1_0", "3_1_1",
+            "2_3_0"};
+    }
+    std::vector<Result> results;
+    for (auto& name : names)
+    {
+        // Each variant is run specialized as in play (see
+        // for_each_fixed_game()).
+        bool found = false;
+        for_each_fixed_game([&]<typename G>(const Variant& rules)
+        {
+            std::string variant_name = std::to_string(rules.num_sizes) + "_" +
+                std::to_string(rules.num_per_size) + "_" +
+                std::to_string(rules.allow_move);
+            if (name == "all" || name == variant_name)
+            {
+                run_both<G>(rules, results);
+                found = true;
+            }
+        });
+        if (!found)
+        {
+            std::cerr << "Unknown rule variant " << name <<
+                " (expected num_sizes_num_per_size_allow_move, or all)." <<
+                std::endl;
+            return 1;
+        }
+    }
+    if (json)
+    {
+        write_json(results);
+    }
+    else
+    {
+        write_csv(results);
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,230 @@
+// Build the cache files for all rule variants supported by gobblet (or those
+// given), solving several at once under a memory budget: each variant
+// reserves the solver's estimate of its peak memory if indexed by rank (see
+// Game::solve_bytes(), 10 times its table, which its measured peaks stay
+// under), or the whole budget if hashed, and runs as soon as its
+// reservation fits, with its share of the threads. Existing valid cache
+// files are kept unless --force is given. A summary of each variant, with
+// the peak memory its solve measured and whether it fell back to solving
+// layer by layer, is written as CSV.
+
+#include "gobblet.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+struct Job
+{
+    Variant rules;
+    std::string name;
+    std::size_t reserve; // bytes of the memory budget
+    bool started;
+    std::string status; // "cached", "solved", "layered" or "failed"
+    SolveStats stats;
+    double seconds;
+    std::uintmax_t bytes; // of cache file
+};
+
+// Solve and save (or just verify) table for given job, using given share of
+// the budget and threads.
+void run(Job& job, int num_threads, bool force, std::ostream* log)
+{
+    auto start = std::chrono::steady_clock::now();
+    std::string filename = "gobblet_" + job.name + ".dat";
+    Game game(log);
+    if (force)
+    {
+        std::remove(filename.c_str());
+        std::remove((filename + ".ckpt").c_str());
+    }
+    if (game.open(job.rules, filename, true))
+    {
+        job.status = "cached";
+    }
+    else
+    {
+        game.set_num_threads(num_threads);
+        game.set_memory_limit(job.reserve);
+        bool built = game.init(job.rules.num_sizes, job.rules.num_per_size,
+            job.rules.allow_move);
+        job.stats = game.stats();
+        job.status = !built ? "failed" :
+            job.stats.layered ? "layered" : "solved";
+    }
+    job.seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    std::error_code error;
+    job.bytes = std::filesystem::file_size(filename, error);
+    if (error)
+    {
+        job.bytes = 0;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int num_jobs = 1;
+    std::size_t budget = Game().memory_limit();
+    bool force = false;
+    std::vector<std::string> names;
+    for (int arg = 1; arg < argc; ++arg)
+    {
+        std::string option = argv[arg];
+        if (option == "--jobs" && arg + 1 < argc)
+        {
+            num_jobs = std::max(1, std::atoi(argv[++arg]));
+        }
+        else if (option == "--memory" && arg + 1 < argc)
+        {
+            budget = std::strtoull(argv[++arg], nullptr, 10) << 20;
+        }
+        else if (option == "--force")
+        {
+            force = true;
+        }
+        else if (option[0] == '-')
+        {
+            std::cerr << "Usage: " << argv[0] << " [--jobs N] " <<
+                "[--memory MiB] [--force] " <<
+                "[num_sizes_num_per_size_allow_move...]" << std::endl;
+            return 1;
+        }
+        else
+        {
+            names.push_back(option);
+        }
+    }
+
+    // As in gobblet, num_per_size is limited by the 9 squares, and to 2 with
+    // 3 sizes (for the table to fit).
+    std::vector<Job> jobs;
+    for (int num_sizes = 1; num_sizes <= 3; ++num_sizes)
+    {
+        for (int num_per_size = 1; num_per_size <= (num_sizes < 3 ? 9 : 2);
+            ++num_per_size)
+        {
+            for (int allow_move = 0; allow_move <= 1; ++allow_move)
+            {
+                Variant rules{num_sizes, num_per_size, allow_move != 0};
+                std::string name = std::to_string(num_sizes) + "_" +
+                    std::to_string(num_per_size) + "_" +
+                    std::to_string(allow_move);
+                if (names.empty() ||
+                    std::find(names.begin(), names.end(), name) != names.end())
+                {
+                    std::size_t bytes = Game().solve_bytes(rules);
+                    jobs.push_back(Job{rules, name, bytes == 0 ? budget :
+                        std::min(budget, bytes), false, "", {}, 0, 0});
+                }
+            }
+        }
+    }
+    for (auto& name : names)
+    {
+        if (std::find_if(jobs.begin(), jobs.end(), [&](const Job& job)
+            {
+                return job.name == name;
+            }) == jobs.end())
+        {
+            std::cerr << "Unknown rule variant " << name << " (expected " <<
+                "num_sizes_num_per_size_allow_move)." << std::endl;
+            return 1;
+        }
+    }
+
+    // Start the largest variants first, so that the longest solves are not
+    // left until last, and then fill the budget with smaller ones.
+    std::vector<Job*> order;
+    for (auto& job : jobs)
+    {
+        order.push_back(&job);
+    }
+    std::stable_sort(order.begin(), order.end(), [](Job* a, Job* b)
+    {
+        return a->reserve > b->reserve;
+    });
+    int num_cores = std::max(1,
+        static_cast<int>(std::thread::hardware_concurrency()));
+    int num_threads = std::max(1, num_cores / num_jobs);
+    std::mutex mutex;
+    std::condition_variable done;
+    std::size_t reserved = 0;
+    int running = 0;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (int worker = 0; worker < num_jobs; ++worker)
+    {
+        workers.emplace_back([&]()
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true)
+            {
+                // Take the first variant waiting that fits in what is left
+                // of the budget (or any, if nothing else is running).
+                Job* job = nullptr;
+                bool waiting = false;
+                for (Job* j : order)
+                {
+                    waiting |= !j->started;
+                    if (job == nullptr && !j->started &&
+                        (running == 0 || reserved + j->reserve <= budget))
+                    {
+                        job = j;
+                    }
+                }
+                if (!waiting)
+                {
+                    return;
+                }
+                if (job == nullptr)
+                {
+                    done.wait(lock);
+                    continue;
+                }
+                job->started = true;
+                reserved += job->reserve;
+                ++running;
+                std::cerr << "Building " << job->name << "..." << std::endl;
+                lock.unlock();
+                run(*job, num_threads, force,
+                    num_jobs == 1 ? &std::cerr : nullptr);
+                lock.lock();
+                std::cerr << "Built " << job->name << " (" << job->status <<
+                    ") in " << job->seconds << " s." << std::endl;
+                reserved -= job->reserve;
+                --running;
+                done.notify_all();
+            }
+        });
+    }
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+
+    std::printf("variant,status,states,solved,search_seconds,"
+        "solve_seconds,seconds,bytes,peak_bytes\n");
+    bool ok = true;
+    for (auto& job : jobs)
+    {
+        std::printf("%s,%s,%zu,%zu,%.3f,%.3f,%.3f,%ju,%zu\n",
+            job.name.c_str(), job.status.c_str(), job.stats.num_states,
+            job.stats.num_solved, job.stats.search_seconds,
+            job.stats.solve_seconds, job.seconds, job.bytes,
+            job.stats.peak_bytes);
+        ok = ok && job.status != "failed";
+    }
+    std::cerr << "Built " << jobs.size() << " variants in " <<
+        std::chrono::duration<double>(std::chrono::steady_clock::now() -
+        start).count() << " s." << std::endl;
+    return ok ? 0 : 1;
+}
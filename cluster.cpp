@@ -0,0 +1,44 @@
+// Solve a rule variant across the nodes of a cluster, each running this with
+// its own index into the same list of node addresses. Node 0 writes the
+// solved table to the cache file that Game::init() would load.
+
+#include "gobblet.h"
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+int main(int argc, char** argv)
+{
+    if (argc < 6)
+    {
+        std::cerr << "Usage: " << argv[0] << " num_sizes num_per_size " <<
+            "allow_move node host:port..." << std::endl;
+        return 1;
+    }
+    Variant rules{std::atoi(argv[1]), std::atoi(argv[2]),
+        std::atoi(argv[3]) != 0};
+    if (rules.num_sizes < 1 || rules.num_sizes > 3 ||
+        rules.num_per_size < 1 ||
+        rules.num_per_size > (rules.num_sizes < 3 ? 9 : 2))
+    {
+        std::cerr << "Rule variant not supported." << std::endl;
+        return 1;
+    }
+    int node = std::atoi(argv[4]);
+    std::vector<std::string> addresses(argv + 5, argv + argc);
+    std::string filename = "gobblet_" + std::to_string(rules.num_sizes) +
+        "_" + std::to_string(rules.num_per_size) + "_" +
+        std::to_string(rules.allow_move) + ".dat";
+    Game game(&std::cout);
+    if (!game.solve_distributed(rules, addresses, node, filename))
+    {
+        std::cerr << "Failed to solve on node " << node << std::endl;
+        return 1;
+    }
+    if (node == 0)
+    {
+        std::cout << "Wrote " << filename << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,4880 @@
+// Retrograde analysis of perfect game play for Gobblet Gobblers and similar
+// 3x3 Tic Tac Toe variants
+
+#ifndef GOBBLET_H
+#define GOBBLET_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <ostream>
+#include <string>
+#include <cstdio>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <memory>
+#include <new>
+#include <utility>
+#include <cstring>
+#include <bit>
+#include <iterator>
+#include <chrono>
+#include <mutex>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#endif
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// A game state is a 54-bit bitboard, 6 bits for each of 3x3=9 squares, 2 bits
+// for each piece size (332211), indicating:
+//   00 = no piece of that size,
+//   01 = piece of player to move, or
+//   10 = opponent's piece.
+typedef std::uint64_t State;
+
+// A move indicates the starting and ending square in {0..8} when moving a
+// piece already on the board, or start in {-1, -2, -3} indicates playing a
+// new piece of the corresponding (negated) size.
+struct Move { int start, end; };
+
+// Rule variations: number of piece sizes (<= 3), number of pieces of each
+// size (per player), and whether pieces already on the board may be moved.
+struct Variant { int num_sizes, num_per_size; bool allow_move; };
+
+// Rules chosen at run time, by set()...
+struct RuntimeRules
+{
+    int num_sizes = 3;
+    int num_per_size = 2;
+    bool allow_move = true;
+
+    bool set(const Variant& rules)
+    {
+        num_sizes = rules.num_sizes;
+        num_per_size = rules.num_per_size;
+        allow_move = rules.allow_move;
+        return true;
+    }
+};
+
+// ... or fixed at compile time, so that move generation and ranking loops
+// are specialized for them, with set() only accepting the same rules.
+template<int NUM_SIZES, int NUM_PER_SIZE, bool ALLOW_MOVE>
+struct FixedRules
+{
+    static constexpr int num_sizes = NUM_SIZES;
+    static constexpr int num_per_size = NUM_PER_SIZE;
+    static constexpr bool allow_move = ALLOW_MOVE;
+
+    bool set(const Variant& rules) const
+    {
+        return rules.num_sizes == num_sizes &&
+            rules.num_per_size == num_per_size &&
+            rules.allow_move == allow_move;
+    }
+};
+
+// Game value for the player to move: win (1), draw (0) or loss (-1) in the
+// given number of moves (or for a draw, with the given number of drawing
+// moves), or not found if the state is not reachable from the initial board.
+struct Evaluation { bool found; int value; std::size_t moves; };
+
+// Number of states found by the last search and solved by the last solve
+// step of the solver (in memory or layer by layer), and the time each step
+// took in seconds; whether it fell back to solving layer by layer; and for
+// a solve in memory, the peak memory it held for the table, its frontiers
+// and checkpoint copies (an upper bound, adding the peak of each).
+struct SolveStats
+{
+    std::size_t num_states = 0;
+    std::size_t num_solved = 0;
+    double search_seconds = 0;
+    double solve_seconds = 0;
+    bool layered = false;
+    std::size_t peak_bytes = 0;
+};
+
+// Fixed-capacity list, so that move generation does not allocate.
+template<typename T, std::size_t N>
+class List
+{
+    T items[N];
+    std::size_t count = 0;
+
+public:
+    void push_back(const T& item) { items[count++] = item; }
+    void resize(std::size_t n) { count = n; }
+    std::size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    T& operator[](std::size_t i) { return items[i]; }
+    const T& operator[](std::size_t i) const { return items[i]; }
+    T* begin() { return items; }
+    T* end() { return items + count; }
+    const T* begin() const { return items; }
+    const T* end() const { return items + count; }
+};
+
+// Sequential reader of (temporary) file of states, buffering a block of them
+// at a time.
+class StateReader
+{
+    std::FILE* fid = nullptr;
+    std::vector<State> buffer;
+    std::size_t next = 0;
+
+public:
+    explicit StateReader(const std::string& filename) :
+        fid(std::fopen(filename.c_str(), "rb"))
+    {
+    }
+
+    StateReader(StateReader&& other) noexcept : fid(other.fid),
+        buffer(std::move(other.buffer)), next(other.next)
+    {
+        other.fid = nullptr;
+    }
+
+    StateReader(const StateReader&) = delete;
+    StateReader& operator=(const StateReader&) = delete;
+
+    ~StateReader()
+    {
+        if (fid != 0)
+        {
+            std::fclose(fid);
+        }
+    }
+
+    // Return false if no states remain, otherwise the next one in s, without
+    // consuming it.
+    bool peek(State& s)
+    {
+        if (next == buffer.size() && fid != 0)
+        {
+            buffer.resize(1 << 16);
+            buffer.resize(std::fread(buffer.data(), sizeof(State),
+                buffer.size(), fid));
+            next = 0;
+        }
+        if (next == buffer.size())
+        {
+            return false;
+        }
+        s = buffer[next];
+        return true;
+    }
+
+    void pop()
+    {
+        ++next;
+    }
+};
+
+// Fixed-size block of game states, the unit of frontier storage.
+struct StateBlock
+{
+    static const std::size_t CAPACITY = 4096;
+    std::size_t size = 0;
+    State states[CAPACITY];
+};
+
+// Pool of free blocks of states, shared by the frontiers of one solver.
+class BlockPool
+{
+    std::mutex mutex{};
+    std::vector<StateBlock*> blocks{};
+    std::size_t num_blocks = 0; // allocated, free or not
+    std::size_t max_blocks = 0;
+
+public:
+    BlockPool() = default;
+    BlockPool(const BlockPool&) = delete;
+    BlockPool& operator=(const BlockPool&) = delete;
+
+    ~BlockPool()
+    {
+        release();
+    }
+
+    StateBlock* get()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!blocks.empty())
+            {
+                StateBlock* block = blocks.back();
+                blocks.pop_back();
+                block->size = 0;
+                return block;
+            }
+            max_blocks = std::max(max_blocks, ++num_blocks);
+        }
+        return new StateBlock;
+    }
+
+    void put(StateBlock* block)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        blocks.push_back(block);
+    }
+
+    // Free all blocks not in use.
+    void release()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (StateBlock* block : blocks)
+        {
+            delete block;
+        }
+        num_blocks -= blocks.size();
+        blocks.clear();
+        blocks.shrink_to_fit();
+    }
+
+    // Return most bytes of blocks allocated at once since reset_peak().
+    std::size_t peak_bytes()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return max_blocks * sizeof(StateBlock);
+    }
+
+    void reset_peak()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        max_blocks = num_blocks;
+    }
+};
+
+// Frontier of game states for a breadth-first search or solve, stored in
+// blocks from a pool: each worker thread appends to its own block, and the
+// blocks of one depth are handed out whole to the threads working on it,
+// each returned to the pool as soon as it is processed. So frontiers hold
+// little more than the states themselves, are never copied or merged
+// between depths, and the current and next depths together take not much
+// more memory than the larger of the two.
+class Frontier
+{
+    BlockPool* pool;
+    std::mutex mutex{};
+    std::vector<StateBlock*> blocks{}; // full, or finished by flush()
+    std::vector<StateBlock*> open; // being filled, per thread
+    std::size_t count = 0; // states in blocks
+
+public:
+    Frontier(BlockPool& pool, int num_threads) : pool(&pool),
+        open(num_threads, nullptr)
+    {
+    }
+
+    Frontier(const Frontier&) = delete;
+    Frontier& operator=(const Frontier&) = delete;
+
+    ~Frontier()
+    {
+        clear();
+    }
+
+    // Append state, from given worker thread.
+    void push(int thread, State s)
+    {
+        StateBlock*& block = open[thread];
+        if (block == nullptr)
+        {
+            block = pool->get();
+        }
+        block->states[block->size++] = s;
+        if (block->size == StateBlock::CAPACITY)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            blocks.push_back(block);
+            count += block->size;
+            block = nullptr;
+        }
+    }
+
+    // Finish appending (once all threads are done), so that all states are
+    // counted by size() and included in blocks().
+    void flush()
+    {
+        for (StateBlock*& block : open)
+        {
+            if (block != nullptr)
+            {
+                blocks.push_back(block);
+                count += block->size;
+                block = nullptr;
+            }
+        }
+    }
+
+    std::size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    // Remove and return all (flushed) blocks, leaving frontier empty.
+    std::vector<StateBlock*> take()
+    {
+        count = 0;
+        std::vector<StateBlock*> taken;
+        taken.swap(blocks);
+        return taken;
+    }
+
+    // Append all (flushed) states to v.
+    void copy_to(std::vector<State>& v) const
+    {
+        for (const StateBlock* block : blocks)
+        {
+            v.insert(v.end(), block->states, block->states + block->size);
+        }
+    }
+
+    // Append n states read from file, returning false if they could not be
+    // read.
+    bool read(std::FILE* fid, std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; i += StateBlock::CAPACITY)
+        {
+            StateBlock* block = pool->get();
+            block->size = std::min(StateBlock::CAPACITY, n - i);
+            blocks.push_back(block);
+            count += block->size;
+            if (std::fread(block->states, sizeof(State), block->size, fid) !=
+                block->size)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void swap(Frontier& other)
+    {
+        flush();
+        other.flush();
+        std::swap(blocks, other.blocks);
+        std::swap(count, other.count);
+    }
+
+    // Return all blocks to the pool.
+    void clear()
+    {
+        flush();
+        for (StateBlock* block : blocks)
+        {
+            pool->put(block);
+        }
+        blocks.clear();
+        count = 0;
+    }
+};
+
+// Uninitialized memory for a large table, using huge pages where available to
+// reduce TLB misses on random probes, and interleaved across NUMA nodes (if
+// more than one) to spread them evenly across memory controllers.
+class TableMemory
+{
+    unsigned char* bytes = nullptr;
+    std::size_t num_bytes = 0; // rounded up to page size
+    std::string pages{};
+    int num_nodes = 1;
+
+public:
+    TableMemory() = default;
+
+    TableMemory(TableMemory&& other) noexcept : bytes(other.bytes),
+        num_bytes(other.num_bytes), pages(std::move(other.pages)),
+        num_nodes(other.num_nodes)
+    {
+        other.bytes = nullptr;
+        other.num_bytes = 0;
+    }
+
+    TableMemory& operator=(TableMemory&& other) noexcept
+    {
+        std::swap(bytes, other.bytes);
+        std::swap(num_bytes, other.num_bytes);
+        std::swap(pages, other.pages);
+        std::swap(num_nodes, other.num_nodes);
+        return *this;
+    }
+
+    TableMemory(const TableMemory&) = delete;
+    TableMemory& operator=(const TableMemory&) = delete;
+
+    ~TableMemory()
+    {
+        release();
+    }
+
+    unsigned char* data() const { return bytes; }
+
+    // Return description of kind of memory obtained, for logging. Once the
+    // memory has been touched, includes how much of it the kernel actually
+    // backed with transparent huge pages.
+    std::string mode() const
+    {
+        std::string result = pages;
+        std::size_t huge = huge_page_bytes();
+        if (pages == "transparent huge pages requested" && huge > 0)
+        {
+            result = "transparent huge pages for " +
+                std::to_string(huge * 100 / num_bytes) + "%";
+        }
+        return result + (num_nodes > 1 ? ", interleaved across " +
+            std::to_string(num_nodes) + " NUMA nodes" : "");
+    }
+
+    // Allocate given number of bytes, returning false if out of memory.
+    bool allocate(std::size_t size)
+    {
+        release();
+#ifndef _WIN32
+        // Explicit huge pages (1 GiB, then 2 MiB) are only available if
+        // reserved by the administrator; otherwise fall back to normal pages,
+        // asking for transparent huge pages.
+        void* mapping = MAP_FAILED;
+#if defined(MAP_HUGETLB) && defined(MAP_HUGE_SHIFT)
+        for (int shift : {30, 21})
+        {
+            std::size_t page_size = std::size_t(1) << shift;
+            if (mapping == MAP_FAILED && size >= page_size)
+            {
+                num_bytes = (size + page_size - 1) & ~(page_size - 1);
+                mapping = mmap(nullptr, num_bytes, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB |
+                    (shift << MAP_HUGE_SHIFT), -1, 0);
+                pages = shift == 30 ? "1 GiB huge pages" : "2 MiB huge pages";
+            }
+        }
+#endif
+        if (mapping == MAP_FAILED)
+        {
+            num_bytes = size;
+            mapping = mmap(nullptr, num_bytes, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            pages = "normal pages";
+#ifdef MADV_HUGEPAGE
+            // A successful madvise does not mean the kernel will back the
+            // mapping with huge pages, so only claim what is confirmed.
+            if (mapping != MAP_FAILED &&
+                madvise(mapping, num_bytes, MADV_HUGEPAGE) == 0)
+            {
+                pages = transparent_enabled() ?
+                    "transparent huge pages requested" :
+                    "normal pages, transparent huge pages disabled";
+            }
+#endif
+        }
+        if (mapping == MAP_FAILED)
+        {
+            num_bytes = 0;
+            return false;
+        }
+        bytes = static_cast<unsigned char*>(mapping);
+        interleave();
+#else
+        bytes = new (std::nothrow) unsigned char[size];
+        num_bytes = size;
+        pages = "normal pages";
+#endif
+        return bytes != nullptr;
+    }
+
+    void release()
+    {
+#ifndef _WIN32
+        if (bytes != nullptr)
+        {
+            munmap(bytes, num_bytes);
+        }
+#else
+        delete[] bytes;
+#endif
+        bytes = nullptr;
+        num_bytes = 0;
+        num_nodes = 1;
+    }
+
+private:
+    // Return false if transparent huge pages are disabled system-wide, in
+    // which case madvise succeeds but has no effect.
+    static bool transparent_enabled()
+    {
+        bool enabled = true;
+#ifdef __linux__
+        std::FILE* fid = std::fopen(
+            "/sys/kernel/mm/transparent_hugepage/enabled", "r");
+        if (fid != nullptr)
+        {
+            char line[128] = {};
+            if (std::fgets(line, sizeof(line), fid) != nullptr)
+            {
+                enabled = std::strstr(line, "[never]") == nullptr;
+            }
+            std::fclose(fid);
+        }
+#endif
+        return enabled;
+    }
+
+    // Return number of bytes of this memory currently backed by transparent
+    // huge pages, summing AnonHugePages over the entries of /proc/self/smaps
+    // that overlap it (the kernel may split the mapping, or merge it with
+    // its neighbours).
+    std::size_t huge_page_bytes() const
+    {
+        std::size_t total = 0;
+#ifdef __linux__
+        if (bytes == nullptr)
+        {
+            return 0;
+        }
+        std::FILE* fid = std::fopen("/proc/self/smaps", "r");
+        if (fid == nullptr)
+        {
+            return 0;
+        }
+        unsigned long begin = reinterpret_cast<unsigned long>(bytes);
+        unsigned long end = begin + num_bytes;
+        bool inside = false;
+        char line[512];
+        while (std::fgets(line, sizeof(line), fid) != nullptr)
+        {
+            unsigned long low = 0, high = 0;
+            std::size_t kib = 0;
+            if (std::sscanf(line, "%lx-%lx ", &low, &high) == 2)
+            {
+                inside = low < end && high > begin;
+            }
+            else if (inside &&
+                std::sscanf(line, "AnonHugePages: %zu kB", &kib) == 1)
+            {
+                total += kib << 10;
+            }
+        }
+        std::fclose(fid);
+#endif
+        return std::min(total, num_bytes);
+    }
+
+    // Set policy of (not yet touched) memory to interleave its pages across
+    // all NUMA nodes, if there is more than one.
+    void interleave()
+    {
+#if defined(__linux__) && defined(SYS_mbind)
+        const int MPOL_INTERLEAVE = 3; // from <linux/mempolicy.h>
+        unsigned long nodes = 0;
+        int count = 0;
+        for (int node = 0; node < 64; ++node)
+        {
+            std::string path = "/sys/devices/system/node/node" +
+                std::to_string(node);
+            if (::access(path.c_str(), F_OK) == 0)
+            {
+                nodes |= 1ul << node;
+                ++count;
+            }
+        }
+        if (count > 1 && syscall(SYS_mbind, bytes, num_bytes, MPOL_INTERLEAVE,
+            &nodes, 8 * sizeof(nodes) + 1, 0) == 0)
+        {
+            num_nodes = count;
+        }
+#endif
+    }
+};
+
+// Connections between the nodes of a distributed solve: a full mesh of TCP
+// sockets, over which each node sends the others batches of game states
+// (in native byte order, so all nodes must share it) once per depth.
+class Cluster
+{
+    int self = 0;
+    std::vector<int> sockets{}; // indexed by node, -1 for self
+    std::atomic<bool> broken{false};
+
+public:
+    Cluster() = default;
+    Cluster(const Cluster&) = delete;
+    Cluster& operator=(const Cluster&) = delete;
+
+    ~Cluster()
+    {
+        close();
+    }
+
+    int node() const { return self; }
+    int size() const { return static_cast<int>(sockets.size()); }
+
+    // Return whether a connection has failed, after which all exchanges
+    // do nothing (and the solve should be abandoned).
+    bool failed() const { return broken; }
+
+    // Connect as given node to all the others, given each node's address as
+    // "host:port": listen on own port, connect to each lower-numbered node
+    // (retrying while it starts), then accept a connection from each
+    // higher-numbered one. Return false if any fails, or if all are not
+    // connected within timeout seconds of starting.
+    bool connect(const std::vector<std::string>& addresses, int node,
+        double timeout = 60)
+    {
+        close();
+        self = node;
+        int n = static_cast<int>(addresses.size());
+        if (node < 0 || node >= n)
+        {
+            return false;
+        }
+        sockets.assign(n, -1);
+#ifndef _WIN32
+        int listener = node + 1 < n ? listen(addresses[node], n) : -1;
+        bool ok = node + 1 == n || listener >= 0;
+        auto start = std::chrono::steady_clock::now();
+        auto remaining_ms = [&]()
+        {
+            double left = timeout - std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - start).count();
+            return left > 0 ? static_cast<int>(left * 1000) + 1 : 0;
+        };
+        for (int peer = 0; ok && peer < node; ++peer)
+        {
+            while ((sockets[peer] = connect(addresses[peer])) < 0 &&
+                remaining_ms() > 0)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            }
+            std::uint64_t id = node;
+            ok = sockets[peer] >= 0 && write_all(sockets[peer], &id,
+                sizeof(id));
+        }
+        for (int i = node + 1; ok && i < n; ++i)
+        {
+            int fd = readable(listener, remaining_ms()) ?
+                ::accept(listener, nullptr, nullptr) : -1;
+            std::uint64_t id = 0;
+            ok = fd >= 0 && readable(fd, remaining_ms()) &&
+                read_all(fd, &id, sizeof(id)) &&
+                id > std::uint64_t(node) && id < std::uint64_t(n) &&
+                sockets[id] < 0;
+            if (ok)
+            {
+                sockets[id] = fd;
+            }
+            else if (fd >= 0)
+            {
+                ::close(fd);
+            }
+        }
+        if (listener >= 0)
+        {
+            ::close(listener);
+        }
+        for (int fd : sockets)
+        {
+            if (fd >= 0)
+            {
+                int one = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            }
+        }
+        if (!ok)
+        {
+            close();
+        }
+        return ok;
+#else
+        return n == 1;
+#endif
+    }
+
+    void close()
+    {
+#ifndef _WIN32
+        for (int& fd : sockets)
+        {
+            if (fd >= 0)
+            {
+                ::close(fd);
+            }
+        }
+#endif
+        sockets.clear();
+        broken = false;
+    }
+
+    // Send out[peer] to each other node, and append the states sent by each
+    // of them to in, in order of node, leaving out empty for re-use. Sends
+    // run in their own threads, so that no node blocks on a full socket
+    // while its peers wait to be read.
+    bool exchange(std::vector<std::vector<State> >& out, std::vector<State>& in)
+    {
+        std::vector<std::thread> senders;
+        for (int peer = 0; peer < size(); ++peer)
+        {
+            if (peer != self)
+            {
+                senders.emplace_back([&, peer]()
+                {
+                    if (!send(peer, out[peer].data(), out[peer].size()))
+                    {
+                        fail();
+                    }
+                });
+            }
+        }
+        for (int peer = 0; peer < size(); ++peer)
+        {
+            if (peer != self && !receive(peer, in))
+            {
+                fail();
+            }
+        }
+        for (auto& sender : senders)
+        {
+            sender.join();
+        }
+        for (auto& v : out)
+        {
+            v.clear();
+        }
+        return !failed();
+    }
+
+    // Return sum of given count over all nodes, or 0 once failed.
+    std::size_t total(std::size_t count)
+    {
+        std::vector<std::vector<State> > out(size(),
+            std::vector<State>(1, count));
+        std::vector<State> in;
+        if (!exchange(out, in))
+        {
+            return 0;
+        }
+        for (State c : in)
+        {
+            count += c;
+        }
+        return count;
+    }
+
+    // Send n states to given node as one message (a count, then the
+    // states); send() of 0 states may be used to mark the end of a stream
+    // of messages.
+    bool send(int peer, const State* states, std::size_t n)
+    {
+        std::uint64_t count = n;
+        return !failed() &&
+            write_all(sockets[peer], &count, sizeof(count)) &&
+            write_all(sockets[peer], states, n * sizeof(State));
+    }
+
+    // Append states of one message from given node to v, returning false
+    // if the connection failed.
+    bool receive(int peer, std::vector<State>& v)
+    {
+        std::uint64_t count = 0;
+        if (failed() || !read_all(sockets[peer], &count, sizeof(count)))
+        {
+            return false;
+        }
+        std::size_t n = v.size();
+        v.resize(n + count);
+        return read_all(sockets[peer], v.data() + n, count * sizeof(State));
+    }
+
+    // Mark connections as failed, shutting them down so that peers blocked
+    // on them fail too.
+    void fail()
+    {
+        broken = true;
+#ifndef _WIN32
+        for (int fd : sockets)
+        {
+            if (fd >= 0)
+            {
+                ::shutdown(fd, SHUT_RDWR);
+            }
+        }
+#endif
+    }
+
+    // Socket helpers, also used by the query server (see server.cpp).
+#ifndef _WIN32
+    // Split "host:port" address into getaddrinfo() results for it.
+    static addrinfo* resolve(const std::string& address, bool passive)
+    {
+        std::size_t colon = address.rfind(':');
+        if (colon == std::string::npos)
+        {
+            return nullptr;
+        }
+        std::string host = address.substr(0, colon);
+        std::string port = address.substr(colon + 1);
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = passive ? AI_PASSIVE : 0;
+        addrinfo* result = nullptr;
+        if (getaddrinfo(passive || host.empty() ? nullptr : host.c_str(),
+            port.c_str(), &hints, &result) != 0)
+        {
+            return nullptr;
+        }
+        return result;
+    }
+
+    // Wait up to given number of milliseconds for socket to be readable (or
+    // for a listening socket, to have a connection to accept).
+    static bool readable(int fd, int ms)
+    {
+        pollfd p{fd, POLLIN, 0};
+        return ::poll(&p, 1, ms) > 0;
+    }
+
+    // Return socket listening on port of given address (on all interfaces),
+    // or -1.
+    static int listen(const std::string& address, int backlog)
+    {
+        addrinfo* result = resolve(address, true);
+        int fd = -1;
+        for (addrinfo* a = result; a != nullptr && fd < 0; a = a->ai_next)
+        {
+            fd = ::socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+            int one = 1;
+            if (fd >= 0 && (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one,
+                sizeof(one)) != 0 || ::bind(fd, a->ai_addr,
+                a->ai_addrlen) != 0 || ::listen(fd, backlog) != 0))
+            {
+                ::close(fd);
+                fd = -1;
+            }
+        }
+        if (result != nullptr)
+        {
+            freeaddrinfo(result);
+        }
+        return fd;
+    }
+
+    // Return socket connected to given address, or -1.
+    static int connect(const std::string& address)
+    {
+        addrinfo* result = resolve(address, false);
+        int fd = -1;
+        for (addrinfo* a = result; a != nullptr && fd < 0; a = a->ai_next)
+        {
+            fd = ::socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+            if (fd >= 0 && ::connect(fd, a->ai_addr, a->ai_addrlen) != 0)
+            {
+                ::close(fd);
+                fd = -1;
+            }
+        }
+        if (result != nullptr)
+        {
+            freeaddrinfo(result);
+        }
+        return fd;
+    }
+
+    static bool write_all(int fd, const void* data, std::size_t size)
+    {
+        const char* p = static_cast<const char*>(data);
+        while (size > 0)
+        {
+            ssize_t n = ::send(fd, p, size, MSG_NOSIGNAL);
+            if (n <= 0)
+            {
+                return false;
+            }
+            p += n;
+            size -= static_cast<std::size_t>(n);
+        }
+        return true;
+    }
+
+    static bool read_all(int fd, void* data, std::size_t size)
+    {
+        char* p = static_cast<char*>(data);
+        while (size > 0)
+        {
+            ssize_t n = ::recv(fd, p, size, 0);
+            if (n <= 0)
+            {
+                return false;
+            }
+            p += n;
+            size -= static_cast<std::size_t>(n);
+        }
+        return true;
+    }
+#else
+    static bool write_all(int, const void*, std::size_t) { return false; }
+    static bool read_all(int, void*, std::size_t) { return false; }
+#endif
+};
+
+// There are at most 9 squares x 8 destinations for moving pieces on the
+// board, plus 3 sizes x 9 squares for playing new pieces; and at most 9
+// squares x (8 sources + 1) to undo a move.
+const std::size_t MAX_MOVES = 9 * 8 + 3 * 9;
+const std::size_t MAX_UNMOVES = 9 * 9;
+typedef List<Move, MAX_MOVES> Moves;
+typedef List<State, MAX_MOVES> NextStates;
+typedef List<State, MAX_UNMOVES> Unmoves;
+
+// Top piece of each of the 64 possible stacks of pieces on one square (the
+// 6 bits of the square in a State): its owner (1 or 2, or 0 if the square is
+// empty) and size (or 0), and a mask of the sizes that could be played or
+// moved on top of it (bit size - 1).
+struct Stack { std::uint8_t owner, size, accepts; };
+
+struct StackTable
+{
+    Stack stacks[64];
+
+    constexpr StackTable() : stacks{}
+    {
+        for (unsigned pieces = 0; pieces < 64; ++pieces)
+        {
+            Stack& stack = stacks[pieces];
+            for (unsigned p = pieces; p != 0; ++stack.size, p >>= 2)
+            {
+                stack.owner = static_cast<std::uint8_t>(p & 0x3);
+            }
+            for (int size = 1; size <= 3; ++size)
+            {
+                if (0x1u << (2 * (size - 1)) > pieces)
+                {
+                    stack.accepts |= static_cast<std::uint8_t>(
+                        0x1u << (size - 1));
+                }
+            }
+        }
+    }
+
+    const Stack& operator[](unsigned pieces) const { return stacks[pieces]; }
+};
+
+inline constexpr StackTable STACKS{};
+
+// Square that each square maps to under each of the 8 symmetries of the
+// board, numbered in the order canonical() and rank() visit them (starting
+// from the identity, alternately mirroring vertically and about the
+// off-diagonal), and the square that maps to each.
+struct SymmetryTable
+{
+    int images[8][9];
+    int inverses[8][9];
+
+    constexpr SymmetryTable() : images{}, inverses{}
+    {
+        int squares[9] = {0, 1, 2, 3, 4, 5, 6, 7, 8};
+        for (int t = 0; t < 8; ++t)
+        {
+            for (int square = 0; square < 9; ++square)
+            {
+                images[t][square] = squares[square];
+                inverses[t][squares[square]] = square;
+            }
+            for (int& square : squares)
+            {
+                int row = square / 3;
+                int col = square % 3;
+                square = t % 2 == 0 ? 3 * (2 - row) + col :
+                    3 * (2 - col) + (2 - row);
+            }
+        }
+    }
+};
+
+inline constexpr SymmetryTable SYMMETRIES{};
+
+// A cached table file starts with this header, identifying the rules and
+// table layout, followed by the table itself.
+struct CacheHeader
+{
+    char magic[8]; // "GOBBLET"
+    std::uint32_t version;
+    std::uint32_t entry_size; // bytes per table entry
+    std::uint8_t num_sizes, num_per_size, allow_move, ranked;
+    std::uint32_t hash_exp; // 0 if ranked
+    std::uint64_t num_entries;
+    std::uint64_t checksum; // of table following header
+};
+
+// A packed table file, for distribution, stores only the entries for states
+// actually reached, keyed by rank (or by state, if not ranked) in sorted
+// order, in blocks of block_size entries. It starts with this header,
+// followed by an index of the first key in each block, the byte offset of
+// each block (and of the end of the last one), and then the blocks. Each
+// block holds its entries' 10-bit values, bit-packed, followed by the
+// differences between successive keys as LEB128 varints, so that looking up
+// one entry decodes only its block.
+struct PackedHeader
+{
+    char magic[8]; // "GOBBLEZ"
+    std::uint32_t version;
+    std::uint32_t block_size; // entries per block
+    std::uint8_t num_sizes, num_per_size, allow_move, ranked;
+    std::uint32_t reserved; // 0
+    std::uint64_t num_entries;
+    std::uint64_t num_blocks;
+    std::uint64_t checksum; // of index and blocks following header
+};
+
+// A frozen table, the compact read-only form of a solved hash map, stores
+// only the entries for states actually reached: their keys (ranks, or the
+// states themselves if not ranked) sorted in Eytzinger (breadth-first)
+// order, so that a lookup is a branch-free descent of an implicit binary
+// search tree whose top levels stay in cache, and their 10-bit values in a
+// parallel array. It starts with this header, followed by the keys and then
+// the values, each indexed from 1 to num_entries (with index 0 unused).
+struct FrozenHeader
+{
+    char magic[8]; // "GOBBLEF"
+    std::uint32_t version;
+    std::uint8_t num_sizes, num_per_size, allow_move, ranked;
+    std::uint64_t num_entries;
+    std::uint64_t checksum; // of keys and values following header
+};
+
+// A checkpoint file of the in-memory solver starts with this header, followed
+// by the table, the current frontier of states (to be searched or solved
+// next), and the game-over states found by search() so far.
+struct CheckpointHeader
+{
+    CacheHeader table; // for cache file of this table
+    std::uint32_t phase; // CHECKPOINT_SEARCH or CHECKPOINT_SOLVE
+    std::uint32_t reserved; // 0
+    std::uint64_t count; // states searched or solved so far
+    std::uint64_t num_entries; // in hash map
+    std::uint64_t num_frontier;
+    std::uint64_t num_solved;
+};
+
+const std::uint32_t CHECKPOINT_SEARCH = 1;
+const std::uint32_t CHECKPOINT_SOLVE = 2;
+
+#ifdef GOBBLET_STATS
+// Optional instrumentation of the solver, compiled in with -DGOBBLET_STATS:
+// each thread counts hash map probe lengths, and for a sample of the states
+// it processes, times the operations on them, adding these to the solver's
+// totals when it finishes its share of a parallel_for().
+const int PROBE_BUCKETS = 16; // probe lengths 1, 2, ..., and longer
+const std::size_t STATS_SAMPLE = 64; // time one in this many states
+enum { TIME_TERMINAL, TIME_MOVES, TIME_CANONICAL, TIME_UNMOVES, TIME_TABLE,
+    NUM_TIMERS };
+const char* const TIMER_NAMES[NUM_TIMERS] = {"terminal", "moves",
+    "canonical", "unmoves", "table"};
+
+struct ThreadStats
+{
+    bool sampling = false;
+    std::uint64_t probes[PROBE_BUCKETS] = {};
+    std::uint64_t ns[NUM_TIMERS] = {};
+};
+
+inline thread_local ThreadStats thread_stats{};
+
+// Add time from construction to destruction to given timer, if sampling.
+class ScopedTimer
+{
+    int timer;
+    std::chrono::steady_clock::time_point start{};
+
+public:
+    explicit ScopedTimer(int timer) : timer(timer)
+    {
+        if (thread_stats.sampling)
+        {
+            start = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~ScopedTimer()
+    {
+        if (thread_stats.sampling)
+        {
+            thread_stats.ns[timer] += std::chrono::duration_cast<
+                std::chrono::nanoseconds>(std::chrono::steady_clock::now() -
+                start).count();
+        }
+    }
+};
+
+#define GOBBLET_TIME(timer) ScopedTimer scoped_timer(timer)
+#define GOBBLET_PROBES(n) ++thread_stats.probes[ \
+    std::min<std::size_t>(n, PROBE_BUCKETS) - 1]
+#else
+#define GOBBLET_TIME(timer)
+#define GOBBLET_PROBES(n)
+#endif
+
+template<typename Rules = RuntimeRules>
+class BasicGame : Rules
+{
+    // Define rule variations:
+    using Rules::num_sizes; // number of piece sizes (<= 3)
+    using Rules::num_per_size; // number of pieces of each size (per player)
+    using Rules::allow_move; // whether pieces already on the board may be moved
+
+    // Store all possible game states using MSI hash map (ref. Chris Wellons
+    // https://nullprogram.com/blog/2022/08/08/) from each 54-bit bitboard key
+    // to its win/loss/draw value packed in the upper 10 bits. If the rules
+    // allow few enough states, instead index a table of just the 10-bit
+    // values directly by rank(s), with no need to store keys.
+    State* hash_map = nullptr;
+    std::uint16_t* values = nullptr;
+    std::size_t table_size = 0;
+    bool ranked = false;
+    bool force_hashed = false; // use the hash map even if states are ranked
+    std::size_t num_ranks = 0;
+    std::size_t num_placements = 0;
+    std::vector<std::uint16_t> placement_rank{}; // indexed by pattern
+    std::vector<std::uint32_t> placement_orbit{}; // orbit << 8 | transforms
+    std::vector<State> placement_states{}; // indexed by placement rank
+    std::vector<std::uint32_t> orbit_placements{}; // least rank in each orbit
+    const std::size_t MAX_RANKS = 1ull << 29;
+
+    // The hash map starts small (or sized for a known number of states), and
+    // grows as needed, keeping load factor num_entries / 2^hash_exp <= 1/2
+    // between steps of the search, and <= 3/4 within them.
+    const int MIN_HASH_EXP = 16;
+    const int MAX_HASH_EXP = 40;
+    int hash_exp = MIN_HASH_EXP;
+    std::size_t hash_mask = (1ull << MIN_HASH_EXP) - 1;
+    std::atomic<std::size_t> num_entries{0};
+    const State STATE_EMPTY = 0x3; // 0x0 is the (valid) initial board state
+    const State STATE_MASK = (1ull << 54) - 1;
+    const std::uint16_t VALUE_EMPTY = 0xffff; // values are only 10 bits
+
+    // Table storage is either allocated, or mapped read-only from a cached
+    // table file so that processes share a single copy in the page cache.
+    TableMemory table_buffer{};
+    void* table_mapping = nullptr;
+    std::size_t mapping_size = 0;
+
+    // Alternatively, a packed table is opened read-only, in which case these
+    // point into its (mapped) file, and hash_map and values are null.
+    const PackedHeader* packed = nullptr;
+    const std::uint64_t* block_keys = nullptr;
+    const std::uint64_t* block_offsets = nullptr;
+    const unsigned char* blocks = nullptr;
+    const std::uint32_t PACKED_BLOCK_SIZE = 256;
+
+    // Or a frozen table, made by freeze() in memory or mapped from its file,
+    // in which case these point into it.
+    const FrozenHeader* frozen = nullptr;
+    const std::uint64_t* frozen_keys = nullptr;
+    const std::uint16_t* frozen_values = nullptr;
+
+    // Progress messages are written to log, if any.
+    std::ostream* log = nullptr;
+
+    // The in-memory solver writes a checkpoint between depths of search()
+    // and solve(), at most every checkpoint_interval seconds (if positive),
+    // from which init() resumes if interrupted. The table is copied to
+    // memory, and written to disk in the background while solving
+    // continues, or if there isn't enough memory to copy it, directly.
+    double checkpoint_interval = 600;
+    std::string checkpoint_file{};
+
+    // Bytes of memory a single table may use, or 0 for the default (see
+    // memory_limit()).
+    std::size_t max_table_bytes = 0;
+    std::chrono::steady_clock::time_point last_checkpoint{};
+    std::thread checkpoint_thread{};
+    std::atomic<bool> checkpoint_busy{false};
+    TableMemory checkpoint_table{};
+    std::vector<State> checkpoint_states{};
+    int num_checkpoints = 0;
+    std::size_t checkpoint_bytes = 0;
+    double checkpoint_stall = 0; // seconds solver waited for checkpoints
+    double checkpoint_write = 0; // seconds writing in the background
+
+    SolveStats solve_stats{};
+
+    // Most bytes of memory held at once by the table (while growing, both the
+    // old and new hash maps) and by checkpoint copies, for SolveStats.
+    std::size_t peak_table_bytes = 0;
+    std::size_t peak_checkpoint_bytes = 0;
+
+    // Free blocks for frontiers of search() and solve().
+    BlockPool block_pool{};
+
+    // Nodes of a distributed solve, if any (see solve_distributed()), each
+    // owning the states whose hashes fall in its share of the hash range.
+    Cluster* cluster = nullptr;
+
+#ifdef GOBBLET_STATS
+    // Totals of thread_stats since the last phase was recorded, and records
+    // of each phase and of each depth of search() and solve().
+    struct PhaseStats
+    {
+        std::string name;
+        std::size_t states;
+        double seconds;
+        std::uint64_t probes[PROBE_BUCKETS];
+        std::uint64_t ns[NUM_TIMERS];
+    };
+    struct LevelStats
+    {
+        std::string phase;
+        std::size_t states;
+        double seconds;
+        double load; // of hash map, at end of depth
+    };
+    std::atomic<std::uint64_t> total_probes[PROBE_BUCKETS] = {};
+    std::atomic<std::uint64_t> total_ns[NUM_TIMERS] = {};
+    std::vector<PhaseStats> phase_stats{};
+    std::vector<LevelStats> level_stats{};
+#endif
+
+    // Number of worker threads used by search() and solve().
+    int num_threads = std::max(1, static_cast<int>(
+        std::thread::hardware_concurrency()));
+
+    // Return index of table entry for given game state, i.e., its rank, or
+    // its hash map slot (possibly empty). Entries may be updated concurrently
+    // by other threads during search() and solve(), so access them through
+    // load(), store() and update().
+    std::size_t find(State s)
+    {
+        return find(slot(s), s);
+    }
+
+    // Return index of table entry for given game state, given its slot().
+    std::size_t find(std::size_t i, State s)
+    {
+        if (ranked)
+        {
+            return i;
+        }
+        GOBBLET_TIME(TIME_TABLE);
+        std::size_t step = (hash(s) >> (64 - hash_exp)) | 1;
+        for (std::size_t probes = 1;; ++probes, i = (i + step) & hash_mask)
+        {
+            State entry = std::atomic_ref<State>(hash_map[i]).load(
+                std::memory_order_relaxed);
+            if (entry == STATE_EMPTY || (entry & STATE_MASK) == s)
+            {
+                GOBBLET_PROBES(probes);
+                return i;
+            }
+        }
+    }
+
+    // Return index of table entry for given game state if ranked, or if
+    // hashed, the first slot probed for it.
+    std::size_t slot(State s)
+    {
+        if (ranked)
+        {
+            return rank(s);
+        }
+        std::uint64_t h = hash(s);
+        return (h + ((h >> (64 - hash_exp)) | 1)) & hash_mask;
+    }
+
+    // Return table entry at index i for game state s, as key and packed
+    // value, or STATE_EMPTY if s has not been found.
+    State load(std::size_t i, State s)
+    {
+        GOBBLET_TIME(TIME_TABLE);
+        if (ranked)
+        {
+            std::uint16_t v = std::atomic_ref<std::uint16_t>(values[i]).load(
+                std::memory_order_relaxed);
+            return v == VALUE_EMPTY ? STATE_EMPTY : s | (State(v) << 54);
+        }
+        return std::atomic_ref<State>(hash_map[i]).load(
+            std::memory_order_relaxed);
+    }
+
+    void store(std::size_t i, State entry)
+    {
+        if (ranked)
+        {
+            std::atomic_ref<std::uint16_t>(values[i]).store(
+                static_cast<std::uint16_t>(entry >> 54),
+                std::memory_order_relaxed);
+        }
+        else
+        {
+            std::atomic_ref<State>(hash_map[i]).store(entry,
+                std::memory_order_relaxed);
+        }
+    }
+
+    // Replace table entry at index i with given entry if it still equals
+    // old, returning true if successful; otherwise, update old to the current
+    // entry (and possibly fail spuriously, as with compare_exchange_weak).
+    bool update(std::size_t i, State& old, State entry)
+    {
+        GOBBLET_TIME(TIME_TABLE);
+        if (ranked)
+        {
+            std::uint16_t v = old == STATE_EMPTY ? VALUE_EMPTY :
+                static_cast<std::uint16_t>(old >> 54);
+            bool updated = std::atomic_ref<std::uint16_t>(values[i]).
+                compare_exchange_weak(v, static_cast<std::uint16_t>(
+                    entry >> 54), std::memory_order_relaxed);
+            old = v == VALUE_EMPTY ? STATE_EMPTY :
+                (entry & STATE_MASK) | (State(v) << 54);
+            return updated;
+        }
+        return std::atomic_ref<State>(hash_map[i]).compare_exchange_weak(old,
+            entry, std::memory_order_relaxed);
+    }
+
+    // Return table entry for given game state.
+    State get(State s)
+    {
+        return packed != nullptr ? get_packed(s) :
+            frozen != nullptr ? get_frozen(s) : load(find(s), s);
+    }
+
+    // Return packed table entry for given game state, decoding only the
+    // block that may contain it.
+    State get_packed(State s)
+    {
+        std::uint64_t key = ranked ? rank(s) : s;
+        std::size_t b = std::upper_bound(block_keys,
+            block_keys + packed->num_blocks, key) - block_keys;
+        if (b-- == 0)
+        {
+            return STATE_EMPTY;
+        }
+        std::size_t n = std::min<std::size_t>(packed->block_size,
+            packed->num_entries - b * packed->block_size);
+        const unsigned char* block = blocks + block_offsets[b];
+        const unsigned char* deltas = block + (10 * n + 7) / 8;
+        std::uint64_t k = block_keys[b];
+        for (std::size_t j = 0; j < n; ++j)
+        {
+            if (j > 0)
+            {
+                k += read_varint(deltas);
+            }
+            if (k >= key)
+            {
+                if (k > key)
+                {
+                    break;
+                }
+                return s | (State(packed_value(block, j)) << 54);
+            }
+        }
+        return STATE_EMPTY;
+    }
+
+    // Return jth 10-bit value of packed block. Each value starts at an even
+    // bit, so it fits in two bytes.
+    static std::uint32_t packed_value(const unsigned char* block,
+        std::size_t j)
+    {
+        std::size_t bit = 10 * j;
+        std::uint32_t word = block[bit / 8] |
+            (std::uint32_t(block[bit / 8 + 1]) << 8);
+        return (word >> (bit % 8)) & 0x3ff;
+    }
+
+    // Return frozen table entry for given game state, descending the implicit
+    // search tree without branching on the keys, and prefetching the keys
+    // four levels down.
+    State get_frozen(State s)
+    {
+        std::uint64_t key = ranked ? rank(s) : s;
+        std::size_t n = frozen->num_entries;
+        std::size_t k = 1;
+        while (k <= n)
+        {
+#if defined(__GNUC__)
+            __builtin_prefetch(frozen_keys + 16 * k);
+#endif
+            k = 2 * k + (frozen_keys[k] < key ? 1 : 0);
+        }
+
+        // Retrace the right turns after the last left one, to the least key
+        // not less than the one searched for.
+        k >>= std::countr_one(k) + 1;
+        return k != 0 && frozen_keys[k] == key ?
+            s | (State(frozen_values[k]) << 54) : STATE_EMPTY;
+    }
+
+    static std::uint64_t read_varint(const unsigned char*& p)
+    {
+        std::uint64_t x = 0;
+        for (int shift = 0;; shift += 7)
+        {
+            unsigned char c = *p++;
+            x |= std::uint64_t(c & 0x7f) << shift;
+            if (c < 0x80)
+            {
+                return x;
+            }
+        }
+    }
+
+    static void write_varint(std::vector<unsigned char>& data, std::uint64_t x)
+    {
+        for (; x >= 0x80; x >>= 7)
+        {
+            data.push_back(static_cast<unsigned char>(x | 0x80));
+        }
+        data.push_back(static_cast<unsigned char>(x));
+    }
+
+    // Prefetch table entry for given game state, returning its slot().
+    // Issuing several prefetches before resolving them with get(i, s) (or
+    // find(i, s) or insert(i, s)) overlaps their cache misses instead of
+    // paying for them one at a time.
+    std::size_t prefetch(State s)
+    {
+        if (packed != nullptr || frozen != nullptr)
+        {
+            return 0;
+        }
+        std::size_t i = slot(s);
+#if defined(__GNUC__)
+        __builtin_prefetch(ranked ? static_cast<const void*>(&values[i]) :
+            static_cast<const void*>(&hash_map[i]));
+#endif
+        return i;
+    }
+
+    State get(std::size_t i, State s)
+    {
+        return packed != nullptr || frozen != nullptr ? get(s) :
+            load(find(i, s), s);
+    }
+
+    // Call f(i, slot) for each of n game states (ignoring any packed value
+    // bits), with slot the state's slot(), prefetching the table entries of
+    // the states PREFETCH_DISTANCE ahead so that their cache misses overlap.
+    template<typename F>
+    void prefetched(const State* states, std::size_t n, F f)
+    {
+        const std::size_t PREFETCH_DISTANCE = 16;
+        std::size_t slots[PREFETCH_DISTANCE];
+        for (std::size_t i = 0; i < std::min(n, PREFETCH_DISTANCE); ++i)
+        {
+            slots[i] = prefetch(states[i] & STATE_MASK);
+        }
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            std::size_t j = i % PREFETCH_DISTANCE;
+            std::size_t slot = slots[j];
+            if (i + PREFETCH_DISTANCE < n)
+            {
+                slots[j] = prefetch(states[i + PREFETCH_DISTANCE] & STATE_MASK);
+            }
+            f(i, slot);
+        }
+    }
+
+    Evaluation evaluation(State entry)
+    {
+        if (entry == STATE_EMPTY)
+        {
+            return Evaluation{false, 0, 0};
+        }
+        return Evaluation{true, unpack_value(entry), unpack_moves(entry)};
+    }
+
+    // Replace list of game states with their table entries, prefetching all
+    // of them before resolving any.
+    void get(NextStates& states)
+    {
+        std::size_t slots[MAX_MOVES];
+        for (std::size_t i = 0; i < states.size(); ++i)
+        {
+            slots[i] = prefetch(states[i]);
+        }
+        for (std::size_t i = 0; i < states.size(); ++i)
+        {
+            states[i] = get(slots[i], states[i]);
+        }
+    }
+
+    // Insert game state into table, returning true if it was not already
+    // present. Empty slots are claimed with compare-and-swap, so threads may
+    // insert concurrently without locking; losing a race to a different state
+    // just continues the probe.
+    bool insert(State s)
+    {
+        return insert(slot(s), s);
+    }
+
+    // Insert game state into table, given its slot().
+    bool insert(std::size_t i, State s)
+    {
+        GOBBLET_TIME(TIME_TABLE);
+        if (ranked)
+        {
+            std::uint16_t v = VALUE_EMPTY;
+            return std::atomic_ref<std::uint16_t>(values[i]).
+                compare_exchange_strong(v, 0, std::memory_order_relaxed);
+        }
+        std::size_t step = (hash(s) >> (64 - hash_exp)) | 1;
+        for (std::size_t probes = 1;; ++probes, i = (i + step) & hash_mask)
+        {
+            std::atomic_ref<State> entry(hash_map[i]);
+            State old = entry.load(std::memory_order_relaxed);
+            if (old == STATE_EMPTY && entry.compare_exchange_strong(old, s,
+                std::memory_order_relaxed))
+            {
+                num_entries.fetch_add(1, std::memory_order_relaxed);
+                GOBBLET_PROBES(probes);
+                return true;
+            }
+            if ((old & STATE_MASK) == s)
+            {
+                GOBBLET_PROBES(probes);
+                return false;
+            }
+        }
+    }
+
+    // SplitMix64
+    std::uint64_t hash(State h)
+    {
+        h ^= h >> 30;
+        h *= 0xbf58476d1ce4e5b9u;
+        h ^= h >> 27;
+        h *= 0x94d049bb133111ebu;
+        h ^= h >> 31;
+        return h;
+    }
+
+    // Return node of a distributed solve that owns given game state.
+    int owner(State s)
+    {
+        return static_cast<int>(((hash(s) >> 32) *
+            static_cast<std::uint64_t>(cluster->size())) >> 32);
+    }
+
+    // Return sum of given count over all nodes, if distributed.
+    std::size_t total(std::size_t count)
+    {
+        return cluster != nullptr ? cluster->total(count) : count;
+    }
+
+    // Send states collected by each thread for other nodes to them, and
+    // append those received to v, leaving the buffers empty for re-use.
+    void exchange(std::vector<std::vector<std::vector<State> > >& remote,
+        std::vector<State>& v)
+    {
+        std::vector<std::vector<State> > out(cluster->size());
+        for (auto& bufs : remote)
+        {
+            for (int node = 0; node < cluster->size(); ++node)
+            {
+                out[node].insert(out[node].end(), bufs[node].begin(),
+                    bufs[node].end());
+                bufs[node].clear();
+            }
+        }
+        cluster->exchange(out, v);
+    }
+
+    // Call f(thread, i) for each i in [0, n), with worker threads claiming
+    // chunks of indices as they go to balance uneven per-state work.
+    template<typename F>
+    void parallel_for(std::size_t n, F f, std::size_t chunk = 1024)
+    {
+        std::atomic<std::size_t> next{0};
+        auto work = [&](int thread)
+        {
+            for (std::size_t begin; (begin = next.fetch_add(chunk)) < n;)
+            {
+                std::size_t end = std::min(begin + chunk, n);
+                for (std::size_t i = begin; i < end; ++i)
+                {
+#ifdef GOBBLET_STATS
+                    thread_stats.sampling = i % STATS_SAMPLE == 0;
+#endif
+                    f(thread, i);
+                }
+            }
+#ifdef GOBBLET_STATS
+            add_thread_stats();
+#endif
+        };
+        std::vector<std::thread> workers;
+        for (int thread = 1; thread < num_threads; ++thread)
+        {
+            workers.emplace_back(work, thread);
+        }
+        work(0);
+        for (auto& worker : workers)
+        {
+            worker.join();
+        }
+    }
+
+    // Call f(thread, states, n) for each block of n states in frontier,
+    // emptying it, with worker threads claiming a block at a time and
+    // returning it to the pool when done.
+    template<typename F>
+    void parallel_for_blocks(Frontier& frontier, F f)
+    {
+        std::vector<StateBlock*> blocks = frontier.take();
+        parallel_for(blocks.size(), [&](int thread, std::size_t b)
+        {
+            f(thread, blocks[b]->states, blocks[b]->size);
+            block_pool.put(blocks[b]);
+        }, 1);
+    }
+
+    // Each depth of search() and solve() is split into kernels, pure
+    // functions of a block of states that write their results to flat
+    // arrays without touching the table (so that one could as well run on
+    // an accelerator), and the merging of their results into the table,
+    // which prefetches entries ahead so that the cache misses of the
+    // random probes overlap.
+
+    // Set entries[i] to the initial table entry of each of n states: a win
+    // or loss in 0 moves if the game is over, or otherwise a tentative draw
+    // with its number of possible (winning) moves, whose (canonical) next
+    // states are appended to children.
+    void search_kernel(const State* states, std::size_t n, State* entries,
+        std::vector<State>& children)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            int value = get_terminal_value(states[i]);
+            if (value != 0)
+            {
+                entries[i] = states[i] | pack(value, 0);
+            }
+            else
+            {
+                NextStates next_states;
+                Moves moves = get_moves(states[i], &next_states);
+                entries[i] = states[i] | pack(0, moves.size());
+                children.insert(children.end(), next_states.begin(),
+                    next_states.end());
+            }
+        }
+    }
+
+    // Append to updates each previous state of each of n solved states with
+    // given table entries, packed with the value and number of moves of the
+    // move from it to back up.
+    void solve_kernel(const State* entries, std::size_t n,
+        std::vector<State>& updates)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            State update = pack(unpack_value(entries[i]),
+                unpack_moves(entries[i]) + 1);
+            for (auto& prev : get_unmoves(entries[i] & STATE_MASK))
+            {
+                updates.push_back(prev | update);
+            }
+        }
+    }
+
+    // Append per-thread buffers to v, leaving the buffers empty for re-use.
+    void gather(std::vector<State>& v, std::vector<std::vector<State> >& bufs)
+    {
+        for (auto& buf : bufs)
+        {
+            v.insert(v.end(), buf.begin(), buf.end());
+            buf.clear();
+        }
+    }
+
+    // First step of retrograde analysis: breadth-first search all states from
+    // initial board, collecting list of solved (game-over won or lost)
+    // states. Each depth of the search is expanded in parallel, with each
+    // thread appending newly found states to the frontier for the next
+    // depth. A hash map is grown between depths as needed, with any states
+    // found when it is too full to insert them deferred until then; return
+    // false if it cannot grow within available memory.
+    bool search(State s0, Frontier& solved)
+    {
+        insert(s0);
+        Frontier frontier(block_pool, num_threads);
+        frontier.push(0, s0);
+        return search(frontier, solved, 0);
+    }
+
+    // Continue search from given frontier of states already in the table,
+    // with count states searched (and given game-over states found) before
+    // it. If distributed, next states owned by other nodes are sent to them
+    // at the end of each depth, and treated like deferred ones there.
+    bool search(Frontier& frontier, Frontier& solved, std::size_t count)
+    {
+        if (log != nullptr)
+        {
+            *log << "Searching... " << std::flush;
+        }
+        auto start = std::chrono::steady_clock::now();
+        Frontier next(block_pool, num_threads);
+        std::vector<std::vector<State> > entry_bufs(num_threads);
+        std::vector<std::vector<State> > child_bufs(num_threads);
+        std::vector<std::vector<State> > deferred(num_threads);
+        std::vector<std::vector<std::vector<State> > > remote(num_threads,
+            std::vector<std::vector<State> >(cluster ? cluster->size() : 0));
+        frontier.flush();
+        for (std::size_t level; (level = total(frontier.size())) != 0;)
+        {
+#ifdef GOBBLET_STATS
+            auto level_start = std::chrono::steady_clock::now();
+            std::size_t level_states = frontier.size();
+#endif
+            count += level;
+            std::size_t max_entries = ranked ? num_ranks :
+                (hash_mask + 1) / 4 * 3;
+            parallel_for_blocks(frontier, [&](int thread, const State* states,
+                std::size_t n)
+            {
+                std::vector<State>& entries = entry_bufs[thread];
+                std::vector<State>& children = child_bufs[thread];
+                entries.resize(n);
+                children.clear();
+                search_kernel(states, n, entries.data(), children);
+
+                // Queue game-over states (as win or loss in 0 moves), and
+                // mark all others as tentative draw (value 0).
+                prefetched(states, n, [&](std::size_t i, std::size_t slot)
+                {
+                    store(find(slot, states[i]), entries[i]);
+                    if (unpack_value(entries[i]) != 0)
+                    {
+                        solved.push(thread, states[i]);
+                    }
+                });
+
+                // Only the thread that inserts a next state queues it,
+                // avoiding duplicate frontier entries.
+                prefetched(children.data(), children.size(),
+                    [&](std::size_t i, std::size_t slot)
+                {
+                    State next_state = children[i];
+                    int node = cluster ? owner(next_state) : 0;
+                    if (cluster && node != cluster->node())
+                    {
+                        remote[thread][node].push_back(next_state);
+                    }
+                    else if (num_entries.load(std::memory_order_relaxed) >=
+                        max_entries)
+                    {
+                        deferred[thread].push_back(next_state);
+                    }
+                    else if (insert(slot, next_state))
+                    {
+                        next.push(thread, next_state);
+                    }
+                });
+            });
+            std::vector<State> more;
+            gather(more, deferred);
+            if (cluster != nullptr)
+            {
+                exchange(remote, more);
+            }
+            if (!ranked && num_entries + more.size() > (hash_mask + 1) / 2 &&
+                !grow(num_entries + more.size()))
+            {
+                if (log != nullptr)
+                {
+                    *log << "out of memory after " << count << " states." <<
+                        std::endl;
+                }
+                return false;
+            }
+            parallel_for(more.size(), [&](int thread, std::size_t i)
+            {
+                if (insert(more[i]))
+                {
+                    next.push(thread, more[i]);
+                }
+            });
+            frontier.swap(next);
+            solved.flush();
+#ifdef GOBBLET_STATS
+            record_level("search", level_states, level_start);
+#endif
+            checkpoint(CHECKPOINT_SEARCH, count, frontier, solved);
+        }
+        solve_stats.num_states = count;
+        solve_stats.search_seconds = seconds_since(start);
+        solve_stats.peak_bytes = peak_bytes();
+#ifdef GOBBLET_STATS
+        record_phase("search", count, solve_stats.search_seconds);
+#endif
+        if (log != nullptr)
+        {
+            *log << "found " << count << " states";
+            if (!ranked)
+            {
+                *log << " (hash map load " << num_entries * 100 /
+                    (hash_mask + 1) << "% of 2^" << hash_exp << ", " <<
+                    table_buffer.mode() << ")";
+            }
+            *log << "." << std::endl;
+        }
+        return true;
+    }
+
+    // Second step of retrograde analysis: work backward breadth-first from
+    // initial list of game-over states, propagating solved win/loss values
+    // and incrementing depth to win. All states solved at the same depth are
+    // processed in parallel, updating each previous state with compare-and-
+    // swap so that only the thread that solves it queues it for the next
+    // depth. If resuming, count states were solved before the given ones.
+    // If distributed, updates of previous states owned by other nodes are
+    // sent to them (as the state with the value and depth of the move to
+    // back up) and applied there at the end of each depth.
+    void solve(Frontier& solved, std::size_t count = 0)
+    {
+        if (log != nullptr)
+        {
+            *log << "Solving... " << std::flush;
+        }
+        auto start = std::chrono::steady_clock::now();
+        Frontier next(block_pool, num_threads);
+        std::vector<std::vector<State> > entry_bufs(num_threads);
+        std::vector<std::vector<State> > update_bufs(num_threads);
+        std::vector<std::vector<std::vector<State> > > remote(num_threads,
+            std::vector<std::vector<State> >(cluster ? cluster->size() : 0));
+        solved.flush();
+        for (std::size_t level; (level = total(solved.size())) != 0;)
+        {
+#ifdef GOBBLET_STATS
+            auto level_start = std::chrono::steady_clock::now();
+            std::size_t level_states = solved.size();
+#endif
+            count += level;
+            parallel_for_blocks(solved, [&](int thread, const State* states,
+                std::size_t n)
+            {
+                std::vector<State>& entries = entry_bufs[thread];
+                std::vector<State>& updates = update_bufs[thread];
+                entries.resize(n);
+                updates.clear();
+                prefetched(states, n, [&](std::size_t i, std::size_t slot)
+                {
+                    entries[i] = get(slot, states[i]);
+                });
+                solve_kernel(entries.data(), n, updates);
+                prefetched(updates.data(), updates.size(),
+                    [&](std::size_t i, std::size_t slot)
+                {
+                    int node = cluster ? owner(updates[i] & STATE_MASK) : 0;
+                    if (cluster && node != cluster->node())
+                    {
+                        remote[thread][node].push_back(updates[i]);
+                    }
+                    else
+                    {
+                        back_up(thread, slot, updates[i], next);
+                    }
+                });
+            });
+            if (cluster != nullptr)
+            {
+                std::vector<State> updates;
+                exchange(remote, updates);
+                const std::size_t CHUNK = 1024;
+                parallel_for((updates.size() + CHUNK - 1) / CHUNK,
+                    [&](int thread, std::size_t c)
+                {
+                    std::size_t begin = c * CHUNK;
+                    prefetched(updates.data() + begin,
+                        std::min(CHUNK, updates.size() - begin),
+                        [&](std::size_t i, std::size_t slot)
+                    {
+                        back_up(thread, slot, updates[begin + i], next);
+                    });
+                }, 1);
+            }
+            solved.swap(next);
+#ifdef GOBBLET_STATS
+            record_level("solve", level_states, level_start);
+#endif
+            checkpoint(CHECKPOINT_SOLVE, count, solved, next);
+        }
+        solve_stats.num_solved = count;
+        solve_stats.solve_seconds = seconds_since(start);
+        solve_stats.peak_bytes = peak_bytes();
+#ifdef GOBBLET_STATS
+        record_phase("solve", count, solve_stats.solve_seconds);
+#endif
+        if (log != nullptr)
+        {
+            *log << "solved " << count << " win/loss states." << std::endl;
+        }
+    }
+
+    // Write checkpoint of current phase of solver, if due, with given count
+    // of states searched or solved and lists of states to resume with.
+    void checkpoint(std::uint32_t phase, std::size_t count,
+        const Frontier& frontier, const Frontier& solved)
+    {
+        if (checkpoint_file.empty() || checkpoint_interval <= 0 ||
+            checkpoint_busy || seconds_since(last_checkpoint) <
+            checkpoint_interval)
+        {
+            return;
+        }
+        auto start = std::chrono::steady_clock::now();
+        if (checkpoint_thread.joinable())
+        {
+            checkpoint_thread.join();
+        }
+        CheckpointHeader h{};
+        h.table = header();
+        h.phase = phase;
+        h.count = count;
+        h.num_entries = num_entries;
+        h.num_frontier = frontier.size();
+        h.num_solved = solved.size();
+        checkpoint_states.clear();
+        checkpoint_states.reserve(frontier.size() + solved.size());
+        frontier.copy_to(checkpoint_states);
+        solved.copy_to(checkpoint_states);
+        std::size_t size = table_bytes();
+        checkpoint_bytes = sizeof(h) + size +
+            checkpoint_states.size() * sizeof(State);
+        ++num_checkpoints;
+
+        // Copy table (in parallel, a block at a time) if there is room.
+        const unsigned char* data = table_data();
+        bool copy = size <= memory_limit() && checkpoint_table.allocate(size);
+        peak_checkpoint_bytes = std::max(peak_checkpoint_bytes,
+            (copy ? size : 0) + checkpoint_states.capacity() * sizeof(State));
+        if (copy)
+        {
+            const std::size_t BLOCK = 1 << 20;
+            unsigned char* dest = checkpoint_table.data();
+            parallel_for((size + BLOCK - 1) / BLOCK, [&](int, std::size_t i)
+            {
+                std::memcpy(dest + i * BLOCK, data + i * BLOCK,
+                    std::min(BLOCK, size - i * BLOCK));
+            });
+            data = dest;
+        }
+        auto write = [this, h, data, size, copy]() mutable
+        {
+            auto begin = std::chrono::steady_clock::now();
+            h.table.checksum = checksum(data, size);
+            write_file(checkpoint_file, {{&h, sizeof(h)}, {data, size},
+                {checkpoint_states.data(),
+                checkpoint_states.size() * sizeof(State)}});
+            checkpoint_table.release();
+            checkpoint_states = std::vector<State>();
+            if (copy)
+            {
+                checkpoint_write += seconds_since(begin);
+            }
+            checkpoint_busy = false;
+        };
+        checkpoint_busy = true;
+        if (copy)
+        {
+            checkpoint_thread = std::thread(write);
+        }
+        else
+        {
+            write();
+        }
+        checkpoint_stall += seconds_since(start);
+        last_checkpoint = std::chrono::steady_clock::now();
+    }
+
+    // Restore table and lists of states from checkpoint file for current
+    // rules, returning its phase, or 0 if it is missing or invalid.
+    std::uint32_t resume(std::size_t& count, Frontier& frontier,
+        Frontier& solved)
+    {
+        std::FILE* fid = std::fopen(checkpoint_file.c_str(), "rb");
+        if (fid == 0)
+        {
+            return 0;
+        }
+        if (log != nullptr)
+        {
+            *log << "Resuming from " << checkpoint_file << std::endl;
+        }
+        CheckpointHeader h{};
+        bool valid = std::fread(&h, sizeof(h), 1, fid) == 1;
+        adopt_hash_exp(h.table);
+        CacheHeader expected = header();
+        expected.checksum = h.table.checksum;
+        valid = valid && std::memcmp(&h.table, &expected, sizeof(expected)) == 0 &&
+            (h.phase == CHECKPOINT_SEARCH || h.phase == CHECKPOINT_SOLVE) &&
+            allocate("", ranked ? 0 : (hash_mask + 1) / 2) &&
+            std::fread(table_buffer.data(), 1, table_bytes(), fid) ==
+            table_bytes() && checksum() == h.table.checksum;
+        valid = valid && frontier.read(fid, h.num_frontier) &&
+            solved.read(fid, h.num_solved) && std::fgetc(fid) == EOF;
+        std::fclose(fid);
+        if (!valid)
+        {
+            if (log != nullptr)
+            {
+                *log << "Ignoring invalid " << checkpoint_file << std::endl;
+            }
+            release();
+            frontier.clear();
+            solved.clear();
+            return 0;
+        }
+        count = h.count;
+        num_entries = h.num_entries;
+        return h.phase;
+    }
+
+    // Wait for any checkpoint being written, report their cost, and remove
+    // the checkpoint file, since the table is finished.
+    void finish_checkpoints()
+    {
+        if (checkpoint_thread.joinable())
+        {
+            checkpoint_thread.join();
+        }
+        if (num_checkpoints > 0 && log != nullptr)
+        {
+            *log << "Wrote " << num_checkpoints << " checkpoints of " <<
+                mib(checkpoint_bytes) << " MiB, stalling " <<
+                checkpoint_stall << " s, with " << checkpoint_write <<
+                " s writing in the background." << std::endl;
+        }
+        if (!checkpoint_file.empty())
+        {
+            std::remove(checkpoint_file.c_str());
+            std::remove((checkpoint_file + ".tmp").c_str());
+            checkpoint_file.clear();
+        }
+    }
+
+    static double seconds_since(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+    }
+
+#ifdef GOBBLET_STATS
+    // Add this thread's counts to the totals, and reset them.
+    void add_thread_stats()
+    {
+        for (int i = 0; i < PROBE_BUCKETS; ++i)
+        {
+            total_probes[i].fetch_add(thread_stats.probes[i],
+                std::memory_order_relaxed);
+        }
+        for (int i = 0; i < NUM_TIMERS; ++i)
+        {
+            total_ns[i].fetch_add(thread_stats.ns[i],
+                std::memory_order_relaxed);
+        }
+        thread_stats = ThreadStats{};
+    }
+
+    double load_factor()
+    {
+        return ranked ? static_cast<double>(solve_stats.num_states) /
+            num_ranks : static_cast<double>(num_entries) / (hash_mask + 1);
+    }
+
+    void record_level(const char* phase, std::size_t states,
+        std::chrono::steady_clock::time_point start)
+    {
+        level_stats.push_back(LevelStats{phase, states, seconds_since(start),
+            ranked ? 0 : load_factor()});
+    }
+
+    // Record phase with the totals since the last one, and reset them.
+    void record_phase(const char* name, std::size_t states, double seconds)
+    {
+        PhaseStats phase{name, states, seconds, {}, {}};
+        for (int i = 0; i < PROBE_BUCKETS; ++i)
+        {
+            phase.probes[i] = total_probes[i].exchange(0);
+        }
+        for (int i = 0; i < NUM_TIMERS; ++i)
+        {
+            phase.ns[i] = total_ns[i].exchange(0);
+        }
+        phase_stats.push_back(phase);
+    }
+#endif
+
+    // Back up move from solve_kernel() to the entry for its previous state
+    // prev, with given slot(), if unsolved, queueing prev for the next depth
+    // if this solves it.
+    void back_up(int thread, std::size_t slot, State move, Frontier& next)
+    {
+        State prev = move & STATE_MASK;
+        int value = unpack_value(move);
+        std::size_t moves = unpack_moves(move);
+        std::size_t entry = find(slot, prev);
+        State old = load(entry, prev);
+        while (unpack_value(old) == 0)
+        {
+            State updated = backup(prev, old, value, moves);
+            if (update(entry, old, updated))
+            {
+                if (unpack_value(updated) != 0)
+                {
+                    next.push(thread, prev);
+                }
+                break;
+            }
+        }
+    }
+
+    // Return updated entry for unsolved previous state prev, with entry old,
+    // given a move to a state with the given value in the given number of
+    // moves.
+    State backup(State prev, State old, int value, std::size_t moves)
+    {
+        if (value == 1)
+        {
+            // Losing move for previous player; decrement number of possible
+            // winning moves, recording loss for previous player if there are
+            // none.
+            std::size_t remaining = unpack_moves(old) - 1;
+            return prev | (remaining != 0 ?
+                pack(0, remaining) : pack(-1, moves));
+        }
+
+        // At least one winning move; record win.
+        return prev | pack(1, moves);
+    }
+
+    // Out-of-core versions of search() and solve(), for rules with more
+    // states than fit in memory. Pieces are only ever played from the
+    // reserve, never returned to it, so states fall into layers by the
+    // numbers (a, b) of pieces on the board for the player to move and the
+    // opponent. Moving a piece leads from (a, b) to (b, a), and playing a new
+    // one to (b, a + 1); so layers (a, b) and (b, a) are searched and solved
+    // together, as layer(s) = min(a, b) << 5 | max(a, b), which depends only
+    // on itself and the (at most two) layers with one more piece. Peak memory
+    // is bounded below by the largest layer, which for (3, 2, true) is the
+    // full board with 101M of the 341M states, so it is only about halved.
+    int layer(State s)
+    {
+        int a = std::popcount(s & 0x15555555555555);
+        int b = std::popcount(s) - a;
+        return std::min(a, b) << 5 | std::max(a, b);
+    }
+
+    // Search each layer in order of total pieces on the board, starting from
+    // the states reached by playing a piece from the previous layers, and
+    // keeping only the current layer's states in memory (sorted, for
+    // de-duplication). States reached in the next layers are spilled to disk
+    // as sorted runs, and each finished layer is written to a file of sorted
+    // states. Set count to the total number of states found, returning false
+    // if a file couldn't be written.
+    bool search_layers(State s0, const std::string& prefix, std::size_t& count)
+    {
+        if (log != nullptr)
+        {
+            *log << "Searching... " << std::flush;
+        }
+        const std::size_t SLICE_SIZE = 1 << 16;
+        const std::size_t RUN_SIZE = 1 << 20;
+        count = 0;
+        std::size_t max_layer = 0;
+        std::vector<int> num_runs(32 << 5);
+        std::vector<std::vector<State> > same(num_threads);
+        std::vector<std::vector<State> > up(num_threads);
+        int max_pieces = num_sizes * num_per_size;
+        for (int total = std::popcount(s0); total <= 2 * max_pieces; ++total)
+        {
+            for (int a = std::max(0, total - max_pieces); 2 * a <= total; ++a)
+            {
+                int n = a << 5 | (total - a);
+                std::vector<State> states;
+                if (n == layer(s0))
+                {
+                    states.push_back(s0);
+                }
+                for (int i = 0; i < num_runs[n]; ++i)
+                {
+                    std::vector<State> run = read_states(
+                        layer_file(prefix, n, "run" + std::to_string(i)));
+                    states.insert(states.end(), run.begin(), run.end());
+                }
+                sort_unique(states);
+                // The first frontier is the whole layer so far, which is
+                // expanded in place rather than copied.
+                std::vector<State> frontier;
+                const std::vector<State>* expand = &states;
+                std::vector<State> run;
+                while (!expand->empty())
+                {
+                    // Expand frontier a slice at a time, keeping only states
+                    // not already in layer (to add to it and continue with).
+                    std::vector<State> fresh;
+                    for (std::size_t begin = 0; begin < expand->size();
+                        begin += SLICE_SIZE)
+                    {
+                        std::size_t end = std::min(begin + SLICE_SIZE,
+                            expand->size());
+                        parallel_for(end - begin,
+                            [&](int thread, std::size_t i)
+                        {
+                            State current = (*expand)[begin + i];
+                            if (get_terminal_value(current) == 0)
+                            {
+                                NextStates next_states;
+                                get_moves(current, &next_states);
+                                for (auto& next_state : next_states)
+                                {
+                                    (layer(next_state) == n ? same : up)[
+                                        thread].push_back(next_state);
+                                }
+                            }
+                        });
+                        std::vector<State> found;
+                        gather(found, same);
+                        sort_unique(found);
+                        std::set_difference(found.begin(), found.end(),
+                            states.begin(), states.end(),
+                            std::back_inserter(fresh));
+                        gather(run, up);
+                        if (run.size() >= RUN_SIZE &&
+                            !write_runs(run, prefix, num_runs))
+                        {
+                            return false;
+                        }
+                    }
+                    sort_unique(fresh);
+                    frontier.swap(fresh);
+                    expand = &frontier;
+                    std::size_t size = states.size();
+                    states.insert(states.end(), frontier.begin(),
+                        frontier.end());
+                    std::inplace_merge(states.begin(), states.begin() + size,
+                        states.end());
+                }
+                count += states.size();
+                max_layer = std::max(max_layer, states.size());
+                if (!write_runs(run, prefix, num_runs) ||
+                    !write_states(layer_file(prefix, n), states))
+                {
+                    return false;
+                }
+            }
+        }
+        if (log != nullptr)
+        {
+            *log << "found " << count << " states (at most " << max_layer <<
+                " per layer)." << std::endl;
+        }
+        return true;
+    }
+
+    // Sort run of states reached in next layers, and write each layer's
+    // states to its own run file, returning false if any couldn't be
+    // written.
+    bool write_runs(std::vector<State>& run, const std::string& prefix,
+        std::vector<int>& num_runs)
+    {
+        sort_unique(run);
+        std::vector<State> layer_run;
+        while (!run.empty())
+        {
+            int n = layer(run[0]);
+            layer_run.clear();
+            auto other = std::remove_if(run.begin(), run.end(), [&](State s)
+            {
+                if (layer(s) == n)
+                {
+                    layer_run.push_back(s);
+                    return true;
+                }
+                return false;
+            });
+            run.erase(other, run.end());
+            if (!write_states(layer_file(prefix, n, "run" +
+                std::to_string(num_runs[n]++)), layer_run))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Solve layers in reverse order of total pieces on the board, each by
+    // working backward breadth-first as in solve(), but with only that
+    // layer's states and values in memory. Propagation from the next layers
+    // is seeded with their solved states, streamed from disk depth by depth,
+    // so that the values are the same as if all layers were solved at once.
+    // Each finished layer is written to the table, and its solved states,
+    // in order of depth, to disk, returning false if they couldn't be.
+    bool solve_layers(State s0, const std::string& prefix)
+    {
+        if (log != nullptr)
+        {
+            *log << "Solving... " << std::flush;
+        }
+        std::size_t count = 0;
+        std::vector<std::vector<State> > next(num_threads);
+        int max_pieces = num_sizes * num_per_size;
+        for (int total = 2 * max_pieces; total >= std::popcount(s0); --total)
+        {
+            for (int a = std::max(0, total - max_pieces); 2 * a <= total; ++a)
+            {
+                int n = a << 5 | (total - a);
+                std::vector<State> states = read_states(layer_file(prefix, n));
+                if (states.empty())
+                {
+                    continue;
+                }
+                std::vector<std::uint16_t> layer_values(states.size());
+
+                // Initialize values as in search(), queueing game-over
+                // states.
+                std::vector<std::vector<State> > solved(1);
+                parallel_for(states.size(), [&](int thread, std::size_t i)
+                {
+                    State current = states[i];
+                    int value = get_terminal_value(current);
+                    State entry = value != 0 ? pack(value, 0) :
+                        pack(0, get_moves(current).size());
+                    layer_values[i] = static_cast<std::uint16_t>(entry >> 54);
+                    if (value != 0)
+                    {
+                        next[thread].push_back(current | entry);
+                    }
+                });
+                gather(solved[0], next);
+
+                // Propagate values to previous states in this layer one depth
+                // at a time, from solved states in this layer and the next.
+                int b = total - a;
+                std::vector<StateReader> seeds;
+                seeds.emplace_back(layer_file(prefix, (a + 1 < b ?
+                    (a + 1) << 5 | b : b << 5 | (a + 1)), "solved"));
+                if (a < b)
+                {
+                    seeds.emplace_back(layer_file(prefix,
+                        a << 5 | (b + 1), "solved"));
+                }
+                std::FILE* fid = std::fopen(
+                    layer_file(prefix, n, "solved").c_str(), "wb");
+                bool written = fid != 0;
+                for (std::size_t depth = 0; written && depth < solved.size();
+                    ++depth)
+                {
+                    auto& current_solved = solved[depth];
+                    std::size_t size = current_solved.size();
+                    for (auto& seed : seeds)
+                    {
+                        for (State entry; seed.peek(entry) &&
+                            unpack_moves(entry) == depth; seed.pop())
+                        {
+                            current_solved.push_back(entry);
+                        }
+                    }
+                    parallel_for(current_solved.size(),
+                        [&](int thread, std::size_t i)
+                    {
+                        State current_entry = current_solved[i];
+                        State current = current_entry & STATE_MASK;
+                        int value = unpack_value(current_entry);
+                        std::size_t moves = unpack_moves(current_entry) + 1;
+                        for (auto& prev : get_unmoves(current))
+                        {
+                            // Skip previous states in other layers, or not
+                            // reachable from the initial board.
+                            auto found = std::lower_bound(states.begin(),
+                                states.end(), prev);
+                            if (found == states.end() || *found != prev)
+                            {
+                                continue;
+                            }
+                            std::atomic_ref<std::uint16_t> v(
+                                layer_values[found - states.begin()]);
+                            std::uint16_t old_value =
+                                v.load(std::memory_order_relaxed);
+                            while (unpack_value(State(old_value) << 54) == 0)
+                            {
+                                State updated = backup(prev,
+                                    prev | State(old_value) << 54, value,
+                                    moves);
+                                if (v.compare_exchange_weak(old_value,
+                                    static_cast<std::uint16_t>(updated >> 54),
+                                    std::memory_order_relaxed))
+                                {
+                                    if (unpack_value(updated) != 0)
+                                    {
+                                        next[thread].push_back(updated);
+                                    }
+                                    break;
+                                }
+                            }
+                        }
+                    });
+                    written = std::fwrite(current_solved.data(), sizeof(State),
+                        size, fid) == size;
+                    count += size;
+                    current_solved = std::vector<State>();
+                    std::vector<State> next_solved;
+                    gather(next_solved, next);
+                    bool more = !next_solved.empty();
+                    for (auto& seed : seeds)
+                    {
+                        State entry;
+                        more = more || seed.peek(entry);
+                    }
+                    if (more)
+                    {
+                        solved.resize(std::max(solved.size(), depth + 2));
+                        solved[depth + 1].swap(next_solved);
+                    }
+                }
+                if (fid != 0)
+                {
+                    written = std::fclose(fid) == 0 && written;
+                }
+                if (!written)
+                {
+                    if (log != nullptr)
+                    {
+                        *log << "Failed to write " << layer_file(prefix, n,
+                            "solved") << std::endl;
+                    }
+                    return false;
+                }
+
+                // Write finished layer to table.
+                parallel_for(states.size(), [&](int, std::size_t i)
+                {
+                    State s = states[i];
+                    insert(s);
+                    store(find(s), s | State(layer_values[i]) << 54);
+                });
+            }
+
+            // Solved states of the next layers are no longer needed.
+            for (int a = std::max(0, total + 1 - max_pieces);
+                2 * a <= total + 1; ++a)
+            {
+                std::remove(layer_file(prefix, a << 5 | (total + 1 - a),
+                    "solved").c_str());
+            }
+        }
+        for (int a = 0; 2 * a <= std::popcount(s0); ++a)
+        {
+            std::remove(layer_file(prefix, a << 5 | (std::popcount(s0) - a),
+                "solved").c_str());
+        }
+        solve_stats.num_solved = count;
+        if (log != nullptr)
+        {
+            *log << "solved " << count << " win/loss states." << std::endl;
+        }
+        return true;
+    }
+
+    // Solve game for current rules with search_layers() and solve_layers(),
+    // with temporary files and the table itself on disk next to the given
+    // cache file, then open it. The table is allocated after the search, so
+    // that a hash map can be sized for the number of states found. If a
+    // temporary file couldn't be written, the cache file is removed rather
+    // than finished, so that it is never taken for a solved table.
+    bool solve_layers(const std::string& filename)
+    {
+        auto start = std::chrono::steady_clock::now();
+        std::size_t count = 0;
+        solve_stats.layered = true;
+        solve_stats.peak_bytes = 0;
+        if (!search_layers(0, filename, count))
+        {
+            if (log != nullptr)
+            {
+                *log << "Failed to write layers of " << filename << std::endl;
+            }
+            remove_layer_files(filename);
+            return false;
+        }
+        solve_stats.num_states = count;
+        solve_stats.search_seconds = seconds_since(start);
+#ifdef GOBBLET_STATS
+        record_phase("search_layers", count, solve_stats.search_seconds);
+#endif
+        if (!allocate(filename, count))
+        {
+            return false;
+        }
+        start = std::chrono::steady_clock::now();
+        if (!solve_layers(0, filename))
+        {
+            release();
+            std::remove(filename.c_str());
+            remove_layer_files(filename);
+            return false;
+        }
+        solve_stats.solve_seconds = seconds_since(start);
+#ifdef GOBBLET_STATS
+        record_phase("solve_layers", count, solve_stats.solve_seconds);
+#endif
+        return finish_file(filename);
+    }
+
+    // Finish writing table allocated by allocate(filename, ...) to the cache
+    // file (or write it, if it did not fit in a mapping), then open it.
+    bool finish_file(const std::string& filename)
+    {
+        if (table_mapping == nullptr)
+        {
+            if (!save(filename))
+            {
+                return false;
+            }
+        }
+        else
+        {
+            CacheHeader h = header();
+            h.checksum = checksum();
+            std::memcpy(table_mapping, &h, sizeof(h));
+        }
+        return load(filename, false);
+    }
+
+    // At the end of a distributed solve, collect the hash maps of all nodes
+    // into node 0, in a table of the given layout (ranked or not) written to
+    // given cache file, while the other nodes send theirs and release them.
+    bool gather_table(bool final_ranked, const std::string& filename)
+    {
+        const std::size_t BATCH = 1 << 16;
+        std::size_t count = cluster->total(num_entries);
+        bool ok = true;
+        if (cluster->node() != 0)
+        {
+            std::vector<State> batch;
+            for (std::size_t i = 0; ok && i < table_size; ++i)
+            {
+                if (hash_map[i] != STATE_EMPTY)
+                {
+                    batch.push_back(hash_map[i]);
+                }
+                if (!batch.empty() && (batch.size() == BATCH ||
+                    i + 1 == table_size))
+                {
+                    ok = cluster->send(0, batch.data(), batch.size());
+                    batch.clear();
+                }
+            }
+            ok = ok && cluster->send(0, nullptr, 0);
+            release();
+        }
+        else
+        {
+            // Keep this node's hash map while allocating the final table.
+            TableMemory part;
+            std::swap(part, table_buffer);
+            const State* part_map = hash_map;
+            std::size_t part_size = table_size;
+            ranked = final_ranked;
+            ok = allocate(filename, count);
+            auto add = [&](State entry)
+            {
+                State s = entry & STATE_MASK;
+                if (!ranked)
+                {
+                    insert(s);
+                }
+                store(find(s), entry);
+            };
+            if (ok)
+            {
+                parallel_for(part_size, [&](int, std::size_t i)
+                {
+                    if (part_map[i] != STATE_EMPTY)
+                    {
+                        add(part_map[i]);
+                    }
+                });
+            }
+            else
+            {
+                cluster->fail();
+            }
+            part.release();
+            std::vector<std::thread> receivers;
+            for (int peer = 1; peer < cluster->size(); ++peer)
+            {
+                receivers.emplace_back([&, peer]()
+                {
+                    std::vector<State> batch;
+                    while (cluster->receive(peer, batch) && !batch.empty())
+                    {
+                        for (State entry : batch)
+                        {
+                            add(entry);
+                        }
+                        batch.clear();
+                    }
+                    if (!batch.empty() || cluster->failed())
+                    {
+                        cluster->fail();
+                    }
+                });
+            }
+            for (auto& receiver : receivers)
+            {
+                receiver.join();
+            }
+            ok = ok && !cluster->failed() && finish_file(filename);
+        }
+        return cluster->total(ok ? 0 : 1) == 0 && !cluster->failed();
+    }
+
+    void sort_unique(std::vector<State>& v)
+    {
+        std::sort(v.begin(), v.end());
+        v.erase(std::unique(v.begin(), v.end()), v.end());
+    }
+
+    // Return name of temporary file of states (or given subset of them) in
+    // given layer.
+    std::string layer_file(const std::string& prefix, int n,
+        const std::string& part = "")
+    {
+        return prefix + ".layer" + std::to_string(n >> 5) + "_" +
+            std::to_string(n & 0x1f) + (part.empty() ? "" : "." + part);
+    }
+
+    // Remove any temporary files of layers left by a failed solve.
+    void remove_layer_files(const std::string& prefix)
+    {
+        int max_pieces = num_sizes * num_per_size;
+        for (int a = 0; a <= max_pieces; ++a)
+        {
+            for (int b = a; b <= max_pieces; ++b)
+            {
+                int n = a << 5 | b;
+                std::remove(layer_file(prefix, n).c_str());
+                std::remove(layer_file(prefix, n, "solved").c_str());
+                for (int i = 0; std::remove(layer_file(prefix, n, "run" +
+                    std::to_string(i)).c_str()) == 0; ++i);
+            }
+        }
+    }
+
+    // Write states to file, returning true if successful.
+    bool write_states(const std::string& filename, const std::vector<State>& v)
+    {
+        std::FILE* fid = std::fopen(filename.c_str(), "wb");
+        if (fid == 0)
+        {
+            return false;
+        }
+        bool written = std::fwrite(v.data(), sizeof(State), v.size(), fid) ==
+            v.size();
+        return std::fclose(fid) == 0 && written;
+    }
+
+    // Read states written by write_states(), removing the file.
+    std::vector<State> read_states(const std::string& filename)
+    {
+        std::vector<State> v;
+        StateReader reader(filename);
+        for (State s; reader.peek(s); reader.pop())
+        {
+            v.push_back(s);
+        }
+        std::remove(filename.c_str());
+        return v;
+    }
+
+    // Set rules and choose table layout, without allocating the table,
+    // returning false if the rules are fixed otherwise.
+    bool set_rules(const Variant& rules)
+    {
+        release();
+        if (!Rules::set(rules))
+        {
+            return false;
+        }
+        init_rank();
+        ranked = num_ranks <= MAX_RANKS && !force_hashed;
+        solve_stats = SolveStats{};
+        peak_table_bytes = 0;
+        peak_checkpoint_bytes = 0;
+        block_pool.reset_peak();
+        return true;
+    }
+
+    // Return peak memory held by the solve in memory so far (see
+    // SolveStats).
+    std::size_t peak_bytes()
+    {
+        return peak_table_bytes + block_pool.peak_bytes() +
+            peak_checkpoint_bytes;
+    }
+
+    // Allocate empty table for current rules, in memory, or if supported
+    // and a filename is given, in a writable mapping of that cache file
+    // (leaving its header to be written when finished), so that the table
+    // need not fit in memory. A hash map is sized for the given number of
+    // states, if known, or starts small to grow during search(). Return
+    // false if out of memory.
+    bool allocate(const std::string& filename = "", std::size_t num_states = 0)
+    {
+        release();
+        if (!ranked)
+        {
+            int exp = MIN_HASH_EXP;
+            for (; exp < MAX_HASH_EXP && (1ull << exp) < 2 * num_states; ++exp);
+            set_hash_exp(exp);
+        }
+        num_entries = 0;
+        table_size = ranked ? num_ranks : hash_mask + 1;
+        unsigned char* data = nullptr;
+        bool allocated = false;
+#ifndef _WIN32
+        if (!filename.empty())
+        {
+            std::size_t size = sizeof(CacheHeader) + table_bytes();
+            // Reserve the file's blocks up front, since running out of disk
+            // while writing through the mapping would be SIGBUS, not an error.
+            int fd = ::open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+            if (fd >= 0 && ftruncate(fd, size) == 0 &&
+                posix_fallocate(fd, 0, size) == 0)
+            {
+                void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED, fd, 0);
+                if (mapping != MAP_FAILED)
+                {
+                    table_mapping = mapping;
+                    mapping_size = size;
+                    data = static_cast<unsigned char*>(mapping) +
+                        sizeof(CacheHeader);
+                }
+            }
+            if (fd >= 0)
+            {
+                ::close(fd);
+            }
+        }
+#endif
+        if (data == nullptr)
+        {
+            if (table_bytes() > memory_limit() ||
+                !table_buffer.allocate(table_bytes()))
+            {
+                if (log != nullptr)
+                {
+                    *log << (table_bytes() > memory_limit() ?
+                        "Memory limit exceeded" : "Out of memory") <<
+                        " for table of " << mib(table_bytes()) << " MiB." <<
+                        std::endl;
+                }
+                return false;
+            }
+            data = table_buffer.data();
+            peak_table_bytes = std::max(peak_table_bytes, table_bytes());
+            allocated = true;
+        }
+        hash_map = ranked ? nullptr : reinterpret_cast<State*>(data);
+        values = ranked ? reinterpret_cast<std::uint16_t*>(data) : nullptr;
+        clear();
+        // Report only after clearing has touched every page, so the huge
+        // pages counted are those the kernel actually provided.
+        if (allocated && log != nullptr)
+        {
+            *log << "Allocated table of " << mib(table_bytes()) <<
+                " MiB (" << table_buffer.mode() << ")." << std::endl;
+        }
+        return true;
+    }
+
+    // Empty table, in parallel, so that (with first-touch NUMA placement)
+    // its pages are spread across the nodes of the worker threads.
+    void clear()
+    {
+        parallel_for(table_size, [&](int, std::size_t i)
+        {
+            if (ranked)
+            {
+                values[i] = VALUE_EMPTY;
+            }
+            else
+            {
+                hash_map[i] = STATE_EMPTY;
+            }
+        });
+    }
+
+    static std::size_t mib(std::size_t bytes)
+    {
+        return (bytes + (1 << 20) - 1) >> 20;
+    }
+
+    void set_hash_exp(int exp)
+    {
+        hash_exp = exp;
+        hash_mask = (1ull << exp) - 1;
+    }
+
+    // Replace in-memory hash map with one large enough to hold the given
+    // number of entries at load factor at most 1/2, re-inserting existing
+    // entries, returning false (keeping the current map) if that would
+    // exceed the size limit or available memory.
+    bool grow(std::size_t num_states)
+    {
+        int exp = hash_exp;
+        for (; exp < MAX_HASH_EXP && (1ull << exp) < 2 * num_states; ++exp);
+        std::size_t size = 1ull << exp;
+        TableMemory buffer;
+        if (table_buffer.data() == nullptr || (size < 2 * num_states) ||
+            size * sizeof(State) > memory_limit() ||
+            !buffer.allocate(size * sizeof(State)))
+        {
+            return false;
+        }
+        std::swap(table_buffer, buffer);
+        State* old_map = hash_map;
+        std::size_t old_size = table_size;
+        peak_table_bytes = std::max(peak_table_bytes,
+            (size + old_size) * sizeof(State));
+        hash_map = reinterpret_cast<State*>(table_buffer.data());
+        table_size = size;
+        set_hash_exp(exp);
+        num_entries = 0;
+        clear();
+        parallel_for(old_size, [&](int, std::size_t i)
+        {
+            State entry = old_map[i];
+            if (entry != STATE_EMPTY)
+            {
+                insert(entry & STATE_MASK);
+                store(find(entry & STATE_MASK), entry);
+            }
+        });
+        return true;
+    }
+
+    void release()
+    {
+#ifndef _WIN32
+        if (table_mapping != nullptr)
+        {
+            munmap(table_mapping, mapping_size);
+        }
+#endif
+        table_mapping = nullptr;
+        mapping_size = 0;
+        table_buffer.release();
+        hash_map = nullptr;
+        values = nullptr;
+        packed = nullptr;
+        block_keys = nullptr;
+        block_offsets = nullptr;
+        blocks = nullptr;
+        frozen = nullptr;
+        frozen_keys = nullptr;
+        frozen_values = nullptr;
+    }
+
+    const unsigned char* table_data()
+    {
+        return ranked ? reinterpret_cast<const unsigned char*>(values) :
+            reinterpret_cast<const unsigned char*>(hash_map);
+    }
+
+    std::size_t table_bytes()
+    {
+        return table_size * (ranked ? sizeof(std::uint16_t) : sizeof(State));
+    }
+
+    // Return header for table of current rules (with checksum left 0).
+    CacheHeader header()
+    {
+        CacheHeader h{};
+        std::memcpy(h.magic, "GOBBLET", 8);
+        h.version = 1;
+        h.entry_size = ranked ? sizeof(std::uint16_t) : sizeof(State);
+        h.num_sizes = static_cast<std::uint8_t>(num_sizes);
+        h.num_per_size = static_cast<std::uint8_t>(num_per_size);
+        h.allow_move = allow_move;
+        h.ranked = ranked;
+        h.hash_exp = ranked ? 0 : hash_exp;
+        h.num_entries = ranked ? num_ranks : hash_mask + 1;
+        return h;
+    }
+
+    // Use hash map size recorded in cache file header, if in range (the rest
+    // of the header is validated against the current rules after).
+    void adopt_hash_exp(const CacheHeader& h)
+    {
+        int exp = static_cast<int>(h.hash_exp);
+        if (!ranked && exp >= MIN_HASH_EXP && exp <= MAX_HASH_EXP)
+        {
+            set_hash_exp(exp);
+        }
+    }
+
+    // Return header for packed table of current rules (with number of
+    // entries and blocks, and checksum, left 0).
+    PackedHeader packed_header()
+    {
+        PackedHeader h{};
+        std::memcpy(h.magic, "GOBBLEZ", 8);
+        h.version = 1;
+        h.block_size = PACKED_BLOCK_SIZE;
+        h.num_sizes = static_cast<std::uint8_t>(num_sizes);
+        h.num_per_size = static_cast<std::uint8_t>(num_per_size);
+        h.allow_move = allow_move;
+        h.ranked = ranked;
+        return h;
+    }
+
+    // Return header for frozen table of current rules (with number of
+    // entries and checksum left 0).
+    FrozenHeader frozen_header()
+    {
+        FrozenHeader h{};
+        std::memcpy(h.magic, "GOBBLEF", 8);
+        h.version = 1;
+        h.num_sizes = static_cast<std::uint8_t>(num_sizes);
+        h.num_per_size = static_cast<std::uint8_t>(num_per_size);
+        h.allow_move = allow_move;
+        h.ranked = ranked;
+        return h;
+    }
+
+    static std::size_t frozen_bytes(std::size_t num_entries)
+    {
+        return sizeof(FrozenHeader) + (num_entries + 1) *
+            (sizeof(std::uint64_t) + sizeof(std::uint16_t));
+    }
+
+    void set_frozen(const unsigned char* data)
+    {
+        frozen = reinterpret_cast<const FrozenHeader*>(data);
+        frozen_keys = reinterpret_cast<const std::uint64_t*>(
+            data + sizeof(FrozenHeader));
+        frozen_values = reinterpret_cast<const std::uint16_t*>(
+            frozen_keys + frozen->num_entries + 1);
+    }
+
+    // Return whether given file starts with given 8-byte magic string, i.e.,
+    // is a packed ("GOBBLEZ") or frozen ("GOBBLEF") table, as opposed to a
+    // cache file.
+    static bool has_magic(const std::string& filename, const char* expected)
+    {
+        char magic[8] = {};
+        std::FILE* fid = std::fopen(filename.c_str(), "rb");
+        if (fid == 0)
+        {
+            return false;
+        }
+        bool read = std::fread(magic, sizeof(magic), 1, fid) == 1;
+        std::fclose(fid);
+        return read && std::memcmp(magic, expected, 8) == 0;
+    }
+
+    static bool is_packed(const std::string& filename)
+    {
+        return has_magic(filename, "GOBBLEZ");
+    }
+
+    // Return true if file is a table written by the original solver, before
+    // cache files had headers: just the 2^k 8-byte slots of its hash map
+    // (with k = 29 there, but any exponent in range is accepted), with empty
+    // slots STATE_EMPTY and no magic.
+    bool is_legacy(const std::string& filename)
+    {
+        std::FILE* fid = std::fopen(filename.c_str(), "rb");
+        if (fid == 0)
+        {
+            return false;
+        }
+        std::uint64_t size = 0;
+        if (std::fseek(fid, 0, SEEK_END) == 0)
+        {
+            long end = std::ftell(fid);
+            size = end > 0 ? static_cast<std::uint64_t>(end) : 0;
+        }
+        std::fclose(fid);
+        return std::has_single_bit(size) &&
+            size >= (sizeof(State) << MIN_HASH_EXP) &&
+            size <= (sizeof(State) << MAX_HASH_EXP) &&
+            !has_magic(filename, "GOBBLET") && !is_packed(filename) &&
+            !has_magic(filename, "GOBBLEF");
+    }
+
+    // Call f(slots, n) for each batch of n slots of legacy table file, in
+    // order, returning false if it couldn't be read.
+    template<typename F>
+    bool for_each_legacy_batch(const std::string& filename, F f)
+    {
+        std::FILE* fid = std::fopen(filename.c_str(), "rb");
+        if (fid == 0)
+        {
+            return false;
+        }
+        std::vector<State> batch(1 << 20);
+        std::size_t n = 0;
+        while ((n = std::fread(batch.data(), sizeof(State), batch.size(),
+            fid)) > 0)
+        {
+            f(batch.data(), n);
+        }
+        bool read = std::ferror(fid) == 0;
+        std::fclose(fid);
+        return read;
+    }
+
+    // Return FNV-1a hash of table, 8 bytes at a time.
+    std::uint64_t checksum()
+    {
+        if (frozen != nullptr)
+        {
+            return checksum(reinterpret_cast<const unsigned char*>(frozen) +
+                sizeof(FrozenHeader), frozen_bytes(frozen->num_entries) -
+                sizeof(FrozenHeader));
+        }
+        return checksum(table_data(), table_bytes());
+    }
+
+    // Return entries of solved (unpacked) table, as key | value << 54, in
+    // order of key.
+    std::vector<State> sorted_entries()
+    {
+        std::vector<State> entries;
+        if (frozen != nullptr)
+        {
+            for (std::size_t k = 1; k <= frozen->num_entries; ++k)
+            {
+                entries.push_back(frozen_keys[k] |
+                    (State(frozen_values[k]) << 54));
+            }
+        }
+        else
+        {
+            for (std::size_t i = 0; i < table_size; ++i)
+            {
+                State entry = load(i, i);
+                if (entry != STATE_EMPTY)
+                {
+                    entries.push_back(entry);
+                }
+            }
+        }
+        std::sort(entries.begin(), entries.end(), [&](State a, State b)
+        {
+            return (a & STATE_MASK) < (b & STATE_MASK);
+        });
+        return entries;
+    }
+
+    // Call f(thread, entry) for each entry of solved table (in any form), as
+    // key | value << 54 with key its state (or rank, if ranked), in parallel
+    // and in no particular order, returning the number of entries. Threads
+    // claim a packed block, or a chunk of other tables, at a time.
+    template<typename F>
+    std::size_t for_each_entry(F f)
+    {
+        const std::size_t CHUNK_SIZE = 1 << 12;
+        std::size_t size = packed != nullptr ? packed->num_blocks :
+            frozen != nullptr ? frozen->num_entries : table_size;
+        std::size_t num_chunks = packed != nullptr ? size :
+            (size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+        std::vector<std::size_t> counts(num_threads, 0);
+        parallel_for(num_chunks, [&](int thread, std::size_t c)
+        {
+            std::size_t count = 0;
+            if (packed != nullptr)
+            {
+                std::size_t n = std::min<std::size_t>(packed->block_size,
+                    packed->num_entries - c * packed->block_size);
+                const unsigned char* block = blocks + block_offsets[c];
+                const unsigned char* deltas = block + (10 * n + 7) / 8;
+                std::uint64_t k = block_keys[c];
+                for (std::size_t j = 0; j < n; ++j)
+                {
+                    k += j > 0 ? read_varint(deltas) : 0;
+                    f(thread, k | (State(packed_value(block, j)) << 54));
+                }
+                count = n;
+            }
+            else
+            {
+                std::size_t end = std::min(size, (c + 1) * CHUNK_SIZE);
+                for (std::size_t i = c * CHUNK_SIZE; i < end; ++i)
+                {
+                    // Frozen keys and values start at index 1.
+                    State entry = frozen != nullptr ? frozen_keys[i + 1] |
+                        (State(frozen_values[i + 1]) << 54) : load(i, i);
+                    if (entry != STATE_EMPTY)
+                    {
+                        f(thread, entry);
+                        ++count;
+                    }
+                }
+            }
+            counts[thread] += count;
+        }, 1);
+        std::size_t total = 0;
+        for (std::size_t count : counts)
+        {
+            total += count;
+        }
+        return total;
+    }
+
+    // Return game state (in some orientation) of table entry from
+    // for_each_entry().
+    State entry_state(State entry)
+    {
+        return ranked ? unrank(entry & STATE_MASK) : entry & STATE_MASK;
+    }
+
+    // Return entry that solving would give game state s, from the entries of
+    // its next states in the table, as search_kernel() and backup() derive
+    // it: a win in one more than the fewest moves of the next states lost,
+    // if any, or else a loss in one more than the most moves of those won,
+    // if all are, or else a draw with the number of next states drawn. Return
+    // STATE_EMPTY if any next state is missing.
+    State derive(State s)
+    {
+        int value = get_terminal_value(s);
+        if (value != 0)
+        {
+            return s | pack(value, 0);
+        }
+        NextStates next;
+        Moves moves = get_moves(s, &next);
+        get(next);
+        std::size_t min_lost = SIZE_MAX;
+        std::size_t max_won = 0;
+        std::size_t drawn = 0;
+        for (State entry : next)
+        {
+            if (entry == STATE_EMPTY)
+            {
+                return STATE_EMPTY;
+            }
+            std::size_t n = unpack_moves(entry);
+            value = unpack_value(entry);
+            min_lost = value < 0 ? std::min(min_lost, n) : min_lost;
+            max_won = value > 0 ? std::max(max_won, n) : max_won;
+            drawn += value == 0 ? 1 : 0;
+        }
+        return s | (min_lost < SIZE_MAX ? pack(1, min_lost + 1) :
+            drawn == 0 && moves.size() > 0 ? pack(-1, max_won + 1) :
+            pack(0, drawn));
+    }
+
+    // Write message about the nth of the differences found by validate() or
+    // compare() to log, if among the first few.
+    void report(std::mutex& mutex, std::size_t n, const std::string& message)
+    {
+        const std::size_t MAX_REPORTS = 10;
+        if (log != nullptr && n < MAX_REPORTS)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            *log << message << (n + 1 == MAX_REPORTS ?
+                " (not reporting any more)" : "") << std::endl;
+        }
+    }
+
+    // Return description of game state, or table entry, for messages.
+    static std::string hex(State s)
+    {
+        char text[32];
+        std::snprintf(text, sizeof(text), "%llx",
+            static_cast<unsigned long long>(s));
+        return text;
+    }
+
+    std::string describe(State entry)
+    {
+        return entry == STATE_EMPTY ? "missing" :
+            std::to_string(unpack_value(entry)) + " in " +
+            std::to_string(unpack_moves(entry));
+    }
+
+    // Fill subtree rooted at index k of the Eytzinger-ordered keys and
+    // values with n sorted entries from index i on, returning the index of
+    // the next entry.
+    std::size_t eytzinger(const State* entries, std::size_t n,
+        std::uint64_t* keys, std::uint16_t* vals, std::size_t k, std::size_t i)
+    {
+        if (k <= n)
+        {
+            i = eytzinger(entries, n, keys, vals, 2 * k, i);
+            keys[k] = entries[i] & STATE_MASK;
+            vals[k] = static_cast<std::uint16_t>(entries[i] >> 54);
+            i = eytzinger(entries, n, keys, vals, 2 * k + 1, i + 1);
+        }
+        return i;
+    }
+
+    // Return FNV-1a hash of data, 8 bytes at a time, continuing from hash h
+    // of any preceding data (whose size must be a multiple of 8).
+    static std::uint64_t checksum(const unsigned char* data, std::size_t size,
+        std::uint64_t h = 0xcbf29ce484222325u)
+    {
+        for (std::size_t i = 0; i < size; i += 8)
+        {
+            std::uint64_t word = 0;
+            std::memcpy(&word, data + i, std::min<std::size_t>(8, size - i));
+            h = (h ^ word) * 0x100000001b3u;
+        }
+        return h;
+    }
+
+public:
+    // Pack win/loss/draw key value into upper 10 bits of state:
+    //   01######## = win for current player in # moves
+    //   10######## = draw with -(#+1) potential winning moves (2's complement)
+    //   11######## = loss in -(#+1) moves (2's complement)
+    State pack(int value, std::size_t moves)
+    {
+        return (value == -1 ? 0 : 1ull << 62) ^
+            ((value == 1 ? moves : 0 - (moves + 1)) << 54);
+    }
+
+    int unpack_value(State s)
+    {
+        return 2 - static_cast<int>(s >> 62);
+    }
+
+    std::size_t unpack_moves(State s)
+    {
+        std::int64_t moves = static_cast<std::int64_t>(s << 2) >> 56; // C++20
+        return moves < 0 ? (-moves - 1) : moves;
+    }
+
+    // With this key-value encoding, the best move maximizes next game state.
+    // Return no move (0 0) if the game is over, since no next states of a
+    // finished game are in the table.
+    Move best_move(State s)
+    {
+        Move best{};
+        if (get_terminal_value(s) != 0)
+        {
+            return best;
+        }
+        State max_next = 0;
+        NextStates next;
+        Moves moves = get_moves(s, &next);
+        get(next);
+        for (std::size_t i = 0; i < moves.size(); ++i)
+        {
+            if (next[i] > max_next)
+            {
+                max_next = next[i];
+                best = moves[i];
+            }
+        }
+        return best;
+    }
+
+    // Return whether given value is a game state for these rules, reachable
+    // or not: no square holds a piece of a size not in play or of both
+    // players, and neither player has played more than num_per_size pieces
+    // of any size.
+    bool is_valid(State s)
+    {
+        if ((s >> 54) != 0 || (s & (s >> 1) & 0x15555555555555ull) != 0)
+        {
+            return false;
+        }
+        for (int size = 1; size <= 3; ++size)
+        {
+            State pieces = s & (0x3ull * 0x1041041041041ull <<
+                (2 * (size - 1)));
+            if ((size > num_sizes && pieces != 0) ||
+                std::popcount(pieces & 0x15555555555555ull) > num_per_size ||
+                std::popcount(pieces & 0x2aaaaaaaaaaaaaull) > num_per_size)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Return whether given move is legal for the current player in given
+    // (valid) game state, i.e., the game is not over and the move is one of
+    // those listed by get_moves(), or equivalent to one by symmetry.
+    bool is_legal(State s, Move m)
+    {
+        if (m.end < 0 || m.end > 8 || get_terminal_value(s) != 0)
+        {
+            return false;
+        }
+        Squares squares = get_squares(s);
+        int size = -m.start;
+        if (m.start >= 0)
+        {
+            if (!allow_move || m.start > 8 ||
+                ((squares.mine >> m.start) & 0x1u) == 0)
+            {
+                return false;
+            }
+            size = squares.sizes[m.start];
+        }
+        else if (size > num_sizes || std::popcount(s &
+            (0x1041041041041ull << (2 * (size - 1)))) >= num_per_size)
+        {
+            return false;
+        }
+        return ((squares.accepts[size - 1] >> m.end) & 0x1u) != 0;
+    }
+
+    // Return value of given game state (in any orientation) for the player
+    // to move.
+    Evaluation evaluate(State s)
+    {
+        return evaluation(get(canonical(s)));
+    }
+
+    // Return value of given canonical() game state, e.g. the key from
+    // canonical(s, symmetry), without canonicalizing it again.
+    Evaluation evaluate_canonical(State key)
+    {
+        return evaluation(get(key));
+    }
+
+    // Evaluate n game states at once, more efficiently than one at a time:
+    // each batch of states is canonicalized and its table entries prefetched
+    // before any are resolved.
+    void evaluate(const State* states, std::size_t n, Evaluation* results)
+    {
+        const std::size_t BATCH = 32;
+        State keys[BATCH];
+        std::size_t slots[BATCH];
+        for (std::size_t begin = 0; begin < n; begin += BATCH)
+        {
+            std::size_t count = std::min(BATCH, n - begin);
+            canonical(states + begin, count, keys);
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                slots[i] = prefetch(keys[i]);
+            }
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                results[begin + i] = evaluation(get(slots[i], keys[i]));
+            }
+        }
+    }
+
+    // Return each move (distinct up to symmetry) from given game state, best
+    // first, with the value of the resulting state for the player to move
+    // next, i.e., the opponent. Return none if the game is over.
+    std::vector<std::pair<Move, Evaluation> > all_move_values(State s)
+    {
+        if (get_terminal_value(s) != 0)
+        {
+            return {};
+        }
+        NextStates next;
+        Moves moves = get_moves(s, &next);
+        get(next);
+        std::vector<std::pair<Move, State> > entries;
+        for (std::size_t i = 0; i < moves.size(); ++i)
+        {
+            entries.push_back({moves[i], next[i]});
+        }
+        std::stable_sort(entries.begin(), entries.end(),
+            [](const std::pair<Move, State>& a, const std::pair<Move, State>& b)
+            {
+                return a.second > b.second;
+            });
+        std::vector<std::pair<Move, Evaluation> > result;
+        for (auto& e : entries)
+        {
+            result.push_back({e.first, evaluation(e.second)});
+        }
+        return result;
+    }
+
+    // Return principal variation from given game state: the best move for
+    // each player in turn (in the orientation of s) to the end of the game,
+    // with the value of each resulting state for the player to move next, as
+    // in all_move_values(). Each step looks up all its next states at once,
+    // prefetching them, and the entry of the one chosen is also the value of
+    // the next step, so no other lookups are needed. A drawn line that could
+    // go on forever stops before repeating a state (up to symmetry).
+    std::vector<std::pair<Move, Evaluation> > principal_variation(State s)
+    {
+        return principal_variation(s, canonical(s));
+    }
+
+    // Return principal variation from given game state, given also its
+    // canonical() key, e.g. from canonical(s, symmetry), so that it is not
+    // canonicalized again.
+    std::vector<std::pair<Move, Evaluation> > principal_variation(State s,
+        State key)
+    {
+        std::vector<std::pair<Move, Evaluation> > line;
+        std::vector<State> seen(1, key);
+        while (get_terminal_value(s) == 0)
+        {
+            NextStates next;
+            Moves moves = get_moves(s, &next);
+            get(next);
+            std::size_t best = 0;
+            for (std::size_t i = 1; i < moves.size(); ++i)
+            {
+                if (next[i] > next[best])
+                {
+                    best = i;
+                }
+            }
+            if (moves.size() == 0 || next[best] == STATE_EMPTY ||
+                std::find(seen.begin(), seen.end(), next[best] & STATE_MASK) !=
+                seen.end())
+            {
+                break;
+            }
+            seen.push_back(next[best] & STATE_MASK);
+            line.push_back({moves[best], evaluation(next[best])});
+            s = swap(move(s, moves[best]));
+        }
+        return line;
+    }
+
+    // Create game with no rules or table; use open() to load a solved table,
+    // or solve_external() to solve one.
+    BasicGame(std::ostream* log = nullptr) : log(log)
+    {
+    }
+
+    // Initialize and solve game for these rules, loading from disk for speed.
+    BasicGame(int num_sizes, int num_per_size, bool allow_move,
+        std::ostream* log = nullptr) : log(log)
+    {
+        init(num_sizes, num_per_size, allow_move);
+    }
+
+    BasicGame(const BasicGame&) = delete;
+    BasicGame& operator=(const BasicGame&) = delete;
+
+    ~BasicGame()
+    {
+        if (checkpoint_thread.joinable())
+        {
+            checkpoint_thread.join();
+        }
+        release();
+    }
+
+    // Set minimum time between checkpoints of the in-memory solver, or 0 to
+    // disable them; this takes effect for subsequent calls to init().
+    void set_checkpoint_interval(double seconds)
+    {
+        checkpoint_interval = seconds;
+    }
+
+    // Set number of bytes of memory a single in-memory table may use, or 0
+    // for the default (half of physical memory); a table that would outgrow
+    // it is solved layer by layer instead. This takes effect for subsequent
+    // solves, as does the number of worker threads (by default, one per
+    // hardware thread).
+    void set_memory_limit(std::size_t bytes)
+    {
+        max_table_bytes = bytes;
+    }
+
+    // Return number of bytes of memory that a single table may use, i.e.,
+    // as set by set_memory_limit(), or by default half of physical memory
+    // where known.
+    std::size_t memory_limit()
+    {
+        if (max_table_bytes != 0)
+        {
+            return max_table_bytes;
+        }
+#ifndef _WIN32
+        long pages = sysconf(_SC_PHYS_PAGES);
+        long page_size = sysconf(_SC_PAGE_SIZE);
+        if (pages > 0 && page_size > 0)
+        {
+            return static_cast<std::size_t>(pages) / 2 *
+                static_cast<std::size_t>(page_size);
+        }
+#endif
+        return SIZE_MAX;
+    }
+
+    void set_num_threads(int n)
+    {
+        num_threads = std::max(1, n);
+    }
+
+    // Set whether subsequent solves use a hash map, sized and grown as
+    // needed, even for rules with few enough states to index the table by
+    // rank. Every variant accepted by gobblet is ranked, so this is how
+    // bench exercises the hash map on them.
+    void set_hashed(bool hashed)
+    {
+        force_hashed = hashed;
+    }
+
+    // Return size in bytes of the table indexed by rank for given rules, or
+    // 0 if that would be too large, so that a hash map of as yet unknown
+    // size is used instead.
+    std::size_t ranked_table_bytes(const Variant& rules)
+    {
+        return set_rules(rules) && ranked ?
+            num_ranks * sizeof(std::uint16_t) : 0;
+    }
+
+    // Return estimate of the peak memory that solving given rules in memory
+    // takes, if indexed by rank, or 0 otherwise: the table and the copy of
+    // it that a checkpoint writes, and 8 bytes per state for the frontiers
+    // and again for the checkpoint's copy of them, counting every rank as a
+    // reachable state. That is 10 times the table; measured peaks (see
+    // SolveStats) are 1.5 to 3 times the table, or 3 to 7 times with a
+    // checkpoint at every depth.
+    std::size_t solve_bytes(const Variant& rules)
+    {
+        return set_rules(rules) && ranked ? 2 * num_ranks *
+            (sizeof(std::uint16_t) + sizeof(State)) : 0;
+    }
+
+    // Load table for given rules from its cache file, or else solve it and
+    // write the cache file. Return true if the cache file was loaded or
+    // written; if only writing it failed, the solved table is still in
+    // memory (see has_table()).
+    bool init(int num_sizes, int num_per_size, bool allow_move)
+    {
+        if (!set_rules(Variant{num_sizes, num_per_size, allow_move}))
+        {
+            return false;
+        }
+
+        // Use cached evaluation of game states if available. Only its header
+        // and size are checked, not its checksum, so that just the pages of
+        // the table actually used are read from disk (see open() to verify).
+        std::string filename = "gobblet_" + std::to_string(num_sizes) + "_" +
+            std::to_string(num_per_size) + "_" +
+            std::to_string(allow_move) + ".dat";
+        if (load(filename, false))
+        {
+            return true;
+        }
+
+        // Cache not found or invalid; solve game and save for future re-use,
+        // resuming from the last checkpoint if interrupted, and falling back
+        // to solving layer by layer if the table outgrows memory.
+        checkpoint_file = filename + ".ckpt";
+        last_checkpoint = std::chrono::steady_clock::now();
+        std::size_t count = 0;
+        Frontier frontier(block_pool, num_threads);
+        Frontier solved(block_pool, num_threads);
+        std::uint32_t phase = resume(count, frontier, solved);
+        if (phase == 0 && allocate())
+        {
+            insert(0);
+            frontier.push(0, 0);
+            phase = CHECKPOINT_SEARCH;
+        }
+        if (phase == 0 || (phase == CHECKPOINT_SEARCH &&
+            !search(frontier, solved, count)))
+        {
+            frontier.clear();
+            solved.clear();
+            block_pool.release();
+            finish_checkpoints();
+            bool solved_layers = solve_layers(filename);
+#ifdef GOBBLET_STATS
+            if (log != nullptr)
+            {
+                write_stats(*log);
+            }
+#endif
+            return solved_layers;
+        }
+        if (phase == CHECKPOINT_SEARCH)
+        {
+            solve(solved);
+        }
+        else
+        {
+            solve(frontier, count);
+        }
+        solved.clear();
+        block_pool.release();
+        bool saved = save(filename);
+        if (!saved && log != nullptr)
+        {
+            *log << "Failed to write " << filename << std::endl;
+        }
+        finish_checkpoints();
+#ifdef GOBBLET_STATS
+        if (log != nullptr)
+        {
+            write_stats(*log);
+        }
+#endif
+        return saved;
+    }
+
+    // Load previously solved table for given rules from cache file (or packed
+    // or frozen table file), without solving if it is missing or invalid,
+    // returning true if successful.
+    bool open(const Variant& rules, const std::string& filename,
+        bool verify = false)
+    {
+        return set_rules(rules) && (is_packed(filename) ?
+            load_packed(filename, verify) : load(filename, verify));
+    }
+
+    // Return whether a table (in any form) is loaded or solved, so that
+    // evaluate() and the other lookups may be used.
+    bool has_table()
+    {
+        return table_data() != nullptr || packed != nullptr ||
+            frozen != nullptr;
+    }
+
+    // Convert cache file of solved table for given rules (or a table written
+    // by the original solver; see is_legacy()) to packed table file,
+    // returning true if successful.
+    bool convert(const Variant& rules, const std::string& filename,
+        const std::string& packed_filename)
+    {
+        if (set_rules(rules) && is_legacy(filename))
+        {
+            return convert_legacy(filename, packed_filename);
+        }
+        return open(rules, filename, true) && save_packed(packed_filename);
+    }
+
+    // Convert legacy table file for current rules to packed table file,
+    // streaming through its slots twice: first collecting its entries (by
+    // rank, if ranked), rejecting the file if any is not a valid canonical
+    // state or two share a key; then, once the packed table is written and
+    // opened, checking that it has exactly those entries. Return true if
+    // successful, leaving the packed table open.
+    bool convert_legacy(const std::string& filename,
+        const std::string& packed_filename)
+    {
+        if (log != nullptr)
+        {
+            *log << "Converting legacy table " << filename << std::endl;
+        }
+        std::vector<State> entries;
+        std::atomic<bool> valid{true};
+        bool read = for_each_legacy_batch(filename, [&](State* slots,
+            std::size_t n)
+        {
+            parallel_for(n, [&](int, std::size_t i)
+            {
+                State s = slots[i] & STATE_MASK;
+                if (slots[i] != STATE_EMPTY)
+                {
+                    // Rank only valid states; the table is rejected anyway
+                    // if any is not.
+                    bool state_valid = is_valid(s) && canonical(s) == s;
+                    valid = valid && state_valid;
+                    slots[i] = (ranked && state_valid ? rank(s) : s) |
+                        (slots[i] & ~STATE_MASK);
+                }
+            });
+            std::copy_if(slots, slots + n, std::back_inserter(entries),
+                [&](State entry)
+            {
+                return entry != STATE_EMPTY;
+            });
+        });
+        std::sort(entries.begin(), entries.end(), [&](State a, State b)
+        {
+            return (a & STATE_MASK) < (b & STATE_MASK);
+        });
+        valid = valid && read && std::adjacent_find(entries.begin(),
+            entries.end(), [&](State a, State b)
+        {
+            return (a & STATE_MASK) == (b & STATE_MASK);
+        }) == entries.end();
+        std::size_t num_entries = entries.size();
+        if (!valid || !write_packed(packed_filename, entries))
+        {
+            if (log != nullptr)
+            {
+                *log << "Ignoring invalid " << filename << std::endl;
+            }
+            return false;
+        }
+        entries = std::vector<State>();
+
+        // Read back each legacy entry from the packed table.
+        if (!load_packed(packed_filename, true) ||
+            packed->num_entries != num_entries)
+        {
+            return false;
+        }
+        std::atomic<std::size_t> bad{0};
+        read = for_each_legacy_batch(filename, [&](State* slots, std::size_t n)
+        {
+            parallel_for(n, [&](int, std::size_t i)
+            {
+                bad += slots[i] != STATE_EMPTY &&
+                    get(slots[i] & STATE_MASK) != slots[i] ? 1 : 0;
+            });
+        });
+        if (log != nullptr)
+        {
+            *log << "Read back " << num_entries << " states from " <<
+                packed_filename << ", " << bad << " different." << std::endl;
+        }
+        return read && bad == 0;
+    }
+
+    // Replace solved table (in memory or mapped from a cache file, but not
+    // packed) by its frozen form in memory, which save() then writes as a
+    // frozen table file, returning false (keeping the table) if there is no
+    // such table or not enough memory. Nothing freezes a table unless asked
+    // (see pack): a frozen table is smaller than the hash map, but lookups
+    // are several times slower.
+    bool freeze()
+    {
+        if (table_data() == nullptr)
+        {
+            return false;
+        }
+        std::vector<State> entries = sorted_entries();
+        std::size_t n = entries.size();
+        TableMemory buffer;
+        if (!buffer.allocate(frozen_bytes(n)))
+        {
+            return false;
+        }
+        FrozenHeader h = frozen_header();
+        h.num_entries = n;
+        auto keys = reinterpret_cast<std::uint64_t*>(buffer.data() + sizeof(h));
+        auto vals = reinterpret_cast<std::uint16_t*>(keys + n + 1);
+        keys[0] = 0;
+        vals[0] = VALUE_EMPTY;
+        eytzinger(entries.data(), n, keys, vals, 1, 0);
+        h.checksum = checksum(buffer.data() + sizeof(h),
+            frozen_bytes(n) - sizeof(h));
+        std::memcpy(buffer.data(), &h, sizeof(h));
+        release();
+        table_buffer = std::move(buffer);
+        set_frozen(table_buffer.data());
+        if (log != nullptr)
+        {
+            *log << "Froze " << n << " states into " << mib(frozen_bytes(n)) <<
+                " MiB." << std::endl;
+        }
+        return true;
+    }
+
+    // Check that solved table (in any form) is consistent: that it has the
+    // initial state, and that the entry of each state it has follows from
+    // those of the state's next states, as derive() does, checking entries in
+    // parallel and writing the first few inconsistent ones to log. Return the
+    // number of inconsistent entries (counting a missing initial state as
+    // one), and set num_checked to the number of entries checked, if given.
+    std::size_t validate(std::size_t* num_checked = nullptr)
+    {
+        std::mutex mutex;
+        std::atomic<std::size_t> bad{0};
+        auto check = [&](State s, State entry)
+        {
+            State expected = derive(s);
+            if (entry == STATE_EMPTY || expected == STATE_EMPTY ||
+                (entry & ~STATE_MASK) != (expected & ~STATE_MASK))
+            {
+                report(mutex, bad++, "State " + hex(s) + " is " +
+                    describe(entry) + (expected == STATE_EMPTY ?
+                    ", but a next state is missing" :
+                    ", expected " + describe(expected)));
+            }
+        };
+        std::size_t count = for_each_entry([&](int, State entry)
+        {
+            State s = entry_state(entry);
+            if (ranked && rank(s) != (entry & STATE_MASK))
+            {
+                // No state has this rank, so search cannot have reached it.
+                report(mutex, bad++, "Rank " + std::to_string(entry &
+                    STATE_MASK) + " is not the rank of any state");
+                return;
+            }
+            check(s, entry);
+        });
+        check(0, get(0));
+        if (num_checked != nullptr)
+        {
+            *num_checked = count;
+        }
+        return bad;
+    }
+
+    // Compare solved table (in any form) with that of other game, for the
+    // same rules (in any form), streaming through this table's entries in
+    // parallel and looking up each in the other table, and then the other's
+    // entries in this one, writing the first few differences to log. Return
+    // the number of states whose entries differ or are in only one table,
+    // and set num_compared to the number of entries in this table, if given.
+    std::size_t compare(BasicGame& other, std::size_t* num_compared = nullptr)
+    {
+        if (num_sizes != other.num_sizes ||
+            num_per_size != other.num_per_size ||
+            allow_move != other.allow_move)
+        {
+            if (log != nullptr)
+            {
+                *log << "Tables are for different rules." << std::endl;
+            }
+            return 1;
+        }
+        std::mutex mutex;
+        std::atomic<std::size_t> bad{0};
+        std::size_t count = for_each_entry([&](int, State entry)
+        {
+            State s = entry_state(entry);
+            State other_entry = other.get(canonical(s));
+            if (other_entry == STATE_EMPTY ||
+                (other_entry & ~STATE_MASK) != (entry & ~STATE_MASK))
+            {
+                report(mutex, bad++, "State " + hex(s) + " is " +
+                    describe(entry) + ", but " + describe(other_entry) +
+                    " in the other table");
+            }
+        });
+
+        // Count the other table's entries missing here directly, rather than
+        // from the number matched, which duplicate or non-canonical entries
+        // in either table (matching the same entry) would throw off.
+        std::atomic<std::size_t> extra{0};
+        other.for_each_entry([&](int, State entry)
+        {
+            extra += get(canonical(other.entry_state(entry))) == STATE_EMPTY ?
+                1 : 0;
+        });
+        if (extra > 0)
+        {
+            report(mutex, bad, std::to_string(extra) +
+                " states are only in the other table");
+        }
+        if (num_compared != nullptr)
+        {
+            *num_compared = count;
+        }
+        return bad + extra;
+    }
+
+    // Solve game for given rules out of core, layer by layer, writing
+    // table to given cache file and then opening it, returning true if
+    // successful.
+    bool solve_external(const Variant& rules, const std::string& filename)
+    {
+        return set_rules(rules) && solve_layers(filename);
+    }
+
+    // Solve game for given rules in memory, without reading or writing a
+    // cache file, returning true if successful (or false if the table does
+    // not fit in memory).
+    bool solve(const Variant& rules)
+    {
+        Frontier solved(block_pool, num_threads);
+        if (!set_rules(rules) || !allocate() || !search(0, solved))
+        {
+            solved.clear();
+            block_pool.release();
+            release();
+            return false;
+        }
+        solve(solved);
+        solved.clear();
+        block_pool.release();
+        return true;
+    }
+
+    // Solve game for given rules in memory across the nodes of a cluster,
+    // given the "host:port" address of each node and the index of this one,
+    // with each node holding only the states it owns in its own hash map,
+    // and exchanging the others' states with them after each depth of the
+    // search and solve. Node 0 then collects the table, writes it to given
+    // cache file, with the same entries as the one written by init() (and
+    // the same bytes, if ranked), and opens it; the other nodes are left with
+    // no table. Return true (on all nodes) if successful.
+    bool solve_distributed(const Variant& rules,
+        const std::vector<std::string>& addresses, int node,
+        const std::string& filename)
+    {
+        Cluster nodes;
+        if (!set_rules(rules) || !nodes.connect(addresses, node))
+        {
+            return false;
+        }
+        cluster = &nodes;
+        bool final_ranked = ranked;
+        ranked = false;
+        Frontier frontier(block_pool, num_threads);
+        Frontier solved(block_pool, num_threads);
+        bool ok = allocate();
+        if (ok && owner(0) == node)
+        {
+            insert(0);
+            frontier.push(0, 0);
+        }
+        if (!ok || !search(frontier, solved, 0))
+        {
+            nodes.fail();
+        }
+        solve(solved);
+        frontier.clear();
+        solved.clear();
+        block_pool.release();
+        ok = !nodes.failed() && gather_table(final_ranked, filename);
+        cluster = nullptr;
+        if (!ok)
+        {
+            if (log != nullptr)
+            {
+                *log << "Distributed solve failed." << std::endl;
+            }
+            release();
+        }
+        return ok;
+    }
+
+    const SolveStats& stats() const
+    {
+        return solve_stats;
+    }
+
+#ifdef GOBBLET_STATS
+    // Write instrumentation of the solver as JSON: the table's load factor,
+    // for each phase, its wall time, hash map probe lengths, and estimated
+    // (from the sampled states) total thread time in each operation, and for
+    // each depth of search and solve, the number of states in its frontier
+    // and their throughput.
+    void write_stats(std::ostream& out)
+    {
+        out << "{\"rules\": [" << num_sizes << ", " << num_per_size << ", " <<
+            allow_move << "],\n \"ranked\": " << (ranked ? "true" : "false") <<
+            ",\n \"table_entries\": " << table_size <<
+            ",\n \"load_factor\": " << load_factor() <<
+            ",\n \"phases\": [";
+        for (std::size_t p = 0; p < phase_stats.size(); ++p)
+        {
+            const PhaseStats& phase = phase_stats[p];
+            out << (p > 0 ? "," : "") << "\n  {\"phase\": \"" << phase.name <<
+                "\", \"states\": " << phase.states << ", \"seconds\": " <<
+                phase.seconds << ",\n   \"probes\": [";
+            for (int i = 0; i < PROBE_BUCKETS; ++i)
+            {
+                out << (i > 0 ? ", " : "") << phase.probes[i];
+            }
+            out << "],\n   \"thread_seconds\": {";
+            for (int i = 0; i < NUM_TIMERS; ++i)
+            {
+                out << (i > 0 ? ", " : "") << "\"" << TIMER_NAMES[i] <<
+                    "\": " << 1e-9 * phase.ns[i] * STATS_SAMPLE;
+            }
+            out << "}}";
+        }
+        out << "],\n \"levels\": [";
+        std::size_t depth = 0;
+        for (std::size_t l = 0; l < level_stats.size(); ++l)
+        {
+            const LevelStats& level = level_stats[l];
+            depth = l > 0 && level.phase == level_stats[l - 1].phase ?
+                depth + 1 : 0;
+            out << (l > 0 ? "," : "") << "\n  {\"phase\": \"" <<
+                level.phase << "\", \"depth\": " << depth <<
+                ", \"states\": " << level.states << ", \"seconds\": " <<
+                level.seconds << ", \"states_per_second\": " <<
+                (level.seconds > 0 ? level.states / level.seconds : 0);
+            if (!ranked)
+            {
+                out << ", \"load_factor\": " << level.load;
+            }
+            out << "}";
+        }
+        out << "]}" << std::endl;
+    }
+#endif
+
+    // Write table to cache file, or if frozen, to frozen table file,
+    // returning true if successful.
+    bool save(const std::string& filename)
+    {
+        if (frozen != nullptr)
+        {
+            return write_file(filename,
+                {{frozen, frozen_bytes(frozen->num_entries)}});
+        }
+        CacheHeader h = header();
+        h.checksum = checksum();
+        return write_file(filename,
+            {{&h, sizeof(h)}, {table_data(), table_bytes()}});
+    }
+
+    // Write the given pieces of data in order to file, by way of a temporary
+    // file flushed to disk and then renamed over it, so that a crash or full
+    // disk never leaves a truncated file under the real name. Return true if
+    // successful.
+    static bool write_file(const std::string& filename,
+        const std::vector<std::pair<const void*, std::size_t> >& parts)
+    {
+        std::string temp = filename + ".tmp";
+        std::FILE* fid = std::fopen(temp.c_str(), "wb");
+        if (fid == 0)
+        {
+            return false;
+        }
+        bool written = true;
+        for (auto& part : parts)
+        {
+            written = written &&
+                std::fwrite(part.first, 1, part.second, fid) == part.second;
+        }
+        written = written && std::fflush(fid) == 0;
+#ifndef _WIN32
+        written = written && ::fsync(fileno(fid)) == 0;
+#endif
+        written = std::fclose(fid) == 0 && written;
+#ifdef _WIN32
+        std::remove(filename.c_str());
+#endif
+        if (!written || std::rename(temp.c_str(), filename.c_str()) != 0)
+        {
+            std::remove(temp.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    // Write solved table (not an already packed one) to packed table file,
+    // returning true if successful.
+    bool save_packed(const std::string& filename)
+    {
+        if (table_data() == nullptr && frozen == nullptr)
+        {
+            return false;
+        }
+        return write_packed(filename, sorted_entries());
+    }
+
+    // Write packed table file of given entries, as key | value << 54 in
+    // order of key (see sorted_entries()), returning true if successful.
+    bool write_packed(const std::string& filename,
+        const std::vector<State>& entries)
+    {
+        PackedHeader h = packed_header();
+        h.num_entries = entries.size();
+        h.num_blocks = (entries.size() + h.block_size - 1) / h.block_size;
+        std::vector<std::uint64_t> index(2 * h.num_blocks + 1);
+        std::vector<unsigned char> data;
+        for (std::size_t b = 0; b < h.num_blocks; ++b)
+        {
+            const State* block = entries.data() + b * h.block_size;
+            std::size_t n = std::min<std::size_t>(h.block_size,
+                entries.size() - b * h.block_size);
+            index[b] = block[0] & STATE_MASK;
+            index[h.num_blocks + b] = data.size();
+            std::size_t start = data.size();
+            data.resize(start + (10 * n + 7) / 8);
+            for (std::size_t j = 0; j < n; ++j)
+            {
+                std::size_t bit = 10 * j;
+                std::uint32_t word =
+                    static_cast<std::uint32_t>(block[j] >> 54) << (bit % 8);
+                data[start + bit / 8] |= static_cast<unsigned char>(word);
+                data[start + bit / 8 + 1] |=
+                    static_cast<unsigned char>(word >> 8);
+            }
+            for (std::size_t j = 1; j < n; ++j)
+            {
+                write_varint(data,
+                    (block[j] & STATE_MASK) - (block[j - 1] & STATE_MASK));
+            }
+        }
+        index.back() = data.size();
+        const unsigned char* index_data =
+            reinterpret_cast<const unsigned char*>(index.data());
+        std::size_t index_bytes = index.size() * sizeof(std::uint64_t);
+        h.checksum = checksum(data.data(), data.size(),
+            checksum(index_data, index_bytes));
+
+        bool written = write_file(filename, {{&h, sizeof(h)},
+            {index_data, index_bytes}, {data.data(), data.size()}});
+        if (written && log != nullptr)
+        {
+            *log << "Packed " << entries.size() << " states into " <<
+                sizeof(h) + index_bytes + data.size() << " bytes." <<
+                std::endl;
+        }
+        return written;
+    }
+
+    // Load packed table for current rules, returning false if it is missing,
+    // or rejecting it if it is truncated or written for different rules or
+    // table layout (or if verify and the checksum doesn't match). As with
+    // load(), the file is memory-mapped read-only where supported.
+    bool load_packed(const std::string& filename, bool verify)
+    {
+        release();
+        const unsigned char* data = nullptr;
+        std::size_t size = 0;
+        if (!map_file(filename, sizeof(PackedHeader), data, size))
+        {
+            return false;
+        }
+        bool valid = false;
+        if (data != nullptr)
+        {
+            PackedHeader h;
+            std::memcpy(&h, data, sizeof(h));
+            PackedHeader expected = packed_header();
+            expected.num_entries = h.num_entries;
+            expected.num_blocks = h.num_blocks;
+            expected.checksum = h.checksum;
+            std::size_t index_bytes = (2 * h.num_blocks + 1) *
+                sizeof(std::uint64_t);
+            valid = std::memcmp(&h, &expected, sizeof(h)) == 0 &&
+                h.num_blocks == (h.num_entries + h.block_size - 1) /
+                h.block_size &&
+                index_bytes <= size - sizeof(h);
+            if (valid)
+            {
+                packed = reinterpret_cast<const PackedHeader*>(data);
+                block_keys = reinterpret_cast<const std::uint64_t*>(
+                    data + sizeof(h));
+                block_offsets = block_keys + h.num_blocks;
+                blocks = data + sizeof(h) + index_bytes;
+                valid = block_offsets[h.num_blocks] ==
+                    size - sizeof(h) - index_bytes &&
+                    (!verify || checksum(blocks, block_offsets[h.num_blocks],
+                    checksum(data + sizeof(h), index_bytes)) == h.checksum);
+            }
+        }
+        if (!valid)
+        {
+            if (log != nullptr)
+            {
+                *log << "Ignoring invalid " << filename << std::endl;
+            }
+            release();
+        }
+        return valid;
+    }
+
+    // Load frozen table for current rules, as load_packed() does a packed one.
+    bool load_frozen(const std::string& filename, bool verify)
+    {
+        release();
+        const unsigned char* data = nullptr;
+        std::size_t size = 0;
+        if (!map_file(filename, sizeof(FrozenHeader), data, size))
+        {
+            return false;
+        }
+        bool valid = false;
+        if (data != nullptr)
+        {
+            FrozenHeader h;
+            std::memcpy(&h, data, sizeof(h));
+            FrozenHeader expected = frozen_header();
+            expected.num_entries = h.num_entries;
+            expected.checksum = h.checksum;
+            valid = std::memcmp(&h, &expected, sizeof(h)) == 0 &&
+                h.num_entries < size && size == frozen_bytes(h.num_entries);
+            if (valid)
+            {
+                set_frozen(data);
+                valid = !verify || checksum() == h.checksum;
+            }
+        }
+        if (!valid)
+        {
+            if (log != nullptr)
+            {
+                *log << "Ignoring invalid " << filename << std::endl;
+            }
+            release();
+        }
+        return valid;
+    }
+
+    // Map whole file read-only where supported (or read it into memory),
+    // setting its data (or null if smaller than min_size, or it couldn't be
+    // mapped or read) and size, and returning false if it couldn't be opened.
+    bool map_file(const std::string& filename, std::size_t min_size,
+        const unsigned char*& data, std::size_t& size)
+    {
+#ifndef _WIN32
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            return false;
+        }
+        if (log != nullptr)
+        {
+            *log << "Loading from " << filename << std::endl;
+        }
+        struct stat st;
+        if (fstat(fd, &st) == 0 &&
+            static_cast<std::size_t>(st.st_size) >= min_size)
+        {
+            size = st.st_size;
+            void* mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+            if (mapping != MAP_FAILED)
+            {
+                table_mapping = mapping;
+                mapping_size = size;
+                data = static_cast<const unsigned char*>(mapping);
+            }
+        }
+        ::close(fd);
+#else
+        std::FILE* fid = std::fopen(filename.c_str(), "rb");
+        if (fid == 0)
+        {
+            return false;
+        }
+        if (log != nullptr)
+        {
+            *log << "Loading from " << filename << std::endl;
+        }
+        if (std::fseek(fid, 0, SEEK_END) == 0)
+        {
+            long end = std::ftell(fid);
+            size = end > 0 ? static_cast<std::size_t>(end) : 0;
+        }
+        std::rewind(fid);
+        if (size >= min_size && table_buffer.allocate(size) &&
+            std::fread(table_buffer.data(), 1, size, fid) == size)
+        {
+            data = table_buffer.data();
+        }
+        std::fclose(fid);
+#endif
+        return true;
+    }
+
+    // Load table for current rules from cache file, returning false if it is
+    // missing, or rejecting it if it is truncated or written for different
+    // rules or table layout (or if verify and the checksum doesn't match).
+    // Where supported, the file is memory-mapped read-only, so that only the
+    // pages actually used are read from disk. A frozen table file is also
+    // accepted in place of a cache file.
+    bool load(const std::string& filename, bool verify)
+    {
+        if (has_magic(filename, "GOBBLEF"))
+        {
+            return load_frozen(filename, verify);
+        }
+        release();
+        CacheHeader h{};
+        bool valid = false;
+#ifndef _WIN32
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            return false;
+        }
+        if (log != nullptr)
+        {
+            *log << "Loading from " << filename << std::endl;
+        }
+        bool read = pread(fd, &h, sizeof(h), 0) == sizeof(h);
+        adopt_hash_exp(h);
+        CacheHeader expected = header();
+        table_size = expected.num_entries;
+        std::size_t size = sizeof(CacheHeader) + table_bytes();
+        struct stat st;
+        if (read && fstat(fd, &st) == 0 &&
+            static_cast<std::size_t>(st.st_size) == size)
+        {
+            void* mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+            if (mapping != MAP_FAILED)
+            {
+                table_mapping = mapping;
+                mapping_size = size;
+                valid = true;
+            }
+        }
+        ::close(fd);
+        unsigned char* data = static_cast<unsigned char*>(table_mapping) +
+            sizeof(CacheHeader);
+#else
+        std::FILE* fid = std::fopen(filename.c_str(), "rb");
+        if (fid == 0)
+        {
+            return false;
+        }
+        if (log != nullptr)
+        {
+            *log << "Loading from " << filename << std::endl;
+        }
+        bool read = std::fread(&h, sizeof(h), 1, fid) == 1;
+        adopt_hash_exp(h);
+        CacheHeader expected = header();
+        table_size = expected.num_entries;
+        read = read && table_buffer.allocate(table_bytes());
+        unsigned char* data = table_buffer.data();
+        valid = read &&
+            std::fread(data, 1, table_bytes(), fid) == table_bytes() &&
+            std::fgetc(fid) == EOF;
+        std::fclose(fid);
+#endif
+        if (valid)
+        {
+            hash_map = ranked ? nullptr : reinterpret_cast<State*>(data);
+            values = ranked ? reinterpret_cast<std::uint16_t*>(data) : nullptr;
+            expected.checksum = h.checksum;
+            valid = std::memcmp(&h, &expected, sizeof(h)) == 0 &&
+                (!verify || checksum() == h.checksum);
+        }
+        if (!valid)
+        {
+            if (log != nullptr)
+            {
+                *log << "Ignoring invalid " << filename << std::endl;
+            }
+            release();
+        }
+        return valid;
+    }
+
+    // Almost all of the above is general to retrograde analysis of any
+    // symmetric two-player game of perfect information. Now implement Gobblet.
+
+    // Make move as current player.
+    State move(State s, Move m)
+    {
+        int size = -m.start;
+        if (m.start >= 0)
+        {
+            // Remove piece already on the board.
+            size = STACKS[(s >> (6 * m.start)) & 0x3f].size;
+            s ^= 0x1ull << (6 * m.start + 2 * (size - 1));
+        }
+        // Place or move piece to new square.
+        return s ^ (0x1ull << (6 * m.end + 2 * (size - 1)));
+    }
+
+    // Swap colors so it's always X to move, reducing state space by ~1/2.
+    State swap(State s)
+    {
+        return ((s & 0x2aaaaaaaaaaaaau) >> 1) | ((s & 0x15555555555555u) << 1);
+    }
+
+    // Rotate/reflect board to minimum representation, reducing space by ~7/8.
+    State canonical(State s)
+    {
+#if defined(__AVX2__)
+        // Compute 4 images of the board that, together with the same 4
+        // rotated 180 degrees, cover all 8 symmetries, and take the minimum
+        // across lanes. (States are < 2^54, so signed comparison is safe.)
+        State a = antitranspose(s);
+        __m256i v = _mm256_set_epi64x(static_cast<long long>(flipud(a)),
+            static_cast<long long>(a), static_cast<long long>(flipud(s)),
+            static_cast<long long>(s));
+        v = min(v, flipud(fliplr(v)));
+        __m128i m = _mm256_castsi256_si128(v);
+        __m128i high = _mm256_extracti128_si256(v, 1);
+        m = _mm_blendv_epi8(m, high, _mm_cmpgt_epi64(m, high));
+        high = _mm_unpackhi_epi64(m, m);
+        m = _mm_blendv_epi8(m, high, _mm_cmpgt_epi64(m, high));
+        return static_cast<State>(_mm_cvtsi128_si64(m));
+#else
+        State min_s = s;
+        s = flipud(s);        min_s = s < min_s ? s : min_s;
+        s = antitranspose(s); min_s = s < min_s ? s : min_s;
+        s = flipud(s);        min_s = s < min_s ? s : min_s;
+        s = antitranspose(s); min_s = s < min_s ? s : min_s;
+        s = flipud(s);        min_s = s < min_s ? s : min_s;
+        s = antitranspose(s); min_s = s < min_s ? s : min_s;
+        s = flipud(s);        min_s = s < min_s ? s : min_s;
+        return min_s;
+#endif
+    }
+
+    // Canonicalize game state, also returning the symmetry (as numbered in
+    // SYMMETRIES) that maps it to its canonical image, so that moves on the
+    // canonical board can be mapped back with untransform() instead of
+    // searching the symmetries again.
+    State canonical(State s, int& symmetry)
+    {
+#if defined(__AVX2__)
+        // As above, but keep all 8 images, in this order of symmetries.
+        const int LANE_SYMMETRIES[8] = {0, 1, 7, 6, 4, 5, 3, 2};
+        State a = antitranspose(s);
+        __m256i v = _mm256_set_epi64x(static_cast<long long>(flipud(a)),
+            static_cast<long long>(a), static_cast<long long>(flipud(s)),
+            static_cast<long long>(s));
+        alignas(32) State images[8];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(images), v);
+        _mm256_store_si256(reinterpret_cast<__m256i*>(images + 4),
+            flipud(fliplr(v)));
+        int min_lane = 0;
+        for (int lane = 1; lane < 8; ++lane)
+        {
+            min_lane = images[lane] < images[min_lane] ? lane : min_lane;
+        }
+        symmetry = LANE_SYMMETRIES[min_lane];
+        return images[min_lane];
+#else
+        State min_s = s;
+        symmetry = 0;
+        for (int t = 1; t < 8; ++t)
+        {
+            s = (t % 2 == 1 ? flipud(s) : antitranspose(s));
+            symmetry = s < min_s ? t : symmetry;
+            min_s = s < min_s ? s : min_s;
+        }
+        return min_s;
+#endif
+    }
+
+    // Return image of game state under given symmetry.
+    State transform(State s, int symmetry)
+    {
+        for (int t = 1; t <= symmetry; ++t)
+        {
+            s = (t % 2 == 1 ? flipud(s) : antitranspose(s));
+        }
+        return s;
+    }
+
+    // Map move on a board to the same move on its image under given
+    // symmetry, and back.
+    Move transform(Move m, int symmetry)
+    {
+        return Move{m.start < 0 ? m.start :
+            SYMMETRIES.images[symmetry][m.start],
+            SYMMETRIES.images[symmetry][m.end]};
+    }
+
+    Move untransform(Move m, int symmetry)
+    {
+        return Move{m.start < 0 ? m.start :
+            SYMMETRIES.inverses[symmetry][m.start],
+            SYMMETRIES.inverses[symmetry][m.end]};
+    }
+
+    // Canonicalize n game states at once (possibly in place), 4 at a time if
+    // AVX2 is available.
+    void canonical(const State* states, std::size_t n, State* result)
+    {
+        GOBBLET_TIME(TIME_CANONICAL);
+        std::size_t i = 0;
+#if defined(__AVX2__)
+        for (; i + 4 <= n; i += 4)
+        {
+            __m256i s = _mm256_loadu_si256(
+                reinterpret_cast<const __m256i*>(states + i));
+            __m256i min_s = s;
+            s = flipud(s);        min_s = min(s, min_s);
+            s = antitranspose(s); min_s = min(s, min_s);
+            s = flipud(s);        min_s = min(s, min_s);
+            s = antitranspose(s); min_s = min(s, min_s);
+            s = flipud(s);        min_s = min(s, min_s);
+            s = antitranspose(s); min_s = min(s, min_s);
+            s = flipud(s);        min_s = min(s, min_s);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(result + i), min_s);
+        }
+#endif
+        for (; i < n; ++i)
+        {
+            result[i] = canonical(states[i]);
+        }
+    }
+
+    // Mirror board vertically, swapping top and bottom rows.
+    State flipud(State s)
+    {
+        return ((s << 36) & 0x3ffff000000000) | (s & 0xffffc0000) | (s >> 36);
+    }
+
+    // Mirror board about off-diagonal.
+    State antitranspose(State s)
+    {
+        return ((s << 48) & 0x3f000000000000) | ((s << 24) & 0xfc0fc0000000) |
+            (s & 0x3f03f03f000) | ((s >> 24) & 0xfc0fc0) | (s >> 48);
+    }
+
+#if defined(__AVX2__)
+    // Vectorized versions of the above (and mirroring board horizontally) on
+    // 4 game states at once.
+    __m256i flipud(__m256i s)
+    {
+        return _mm256_or_si256(_mm256_or_si256(
+            _mm256_and_si256(_mm256_slli_epi64(s, 36),
+                _mm256_set1_epi64x(0x3ffff000000000)),
+            _mm256_and_si256(s, _mm256_set1_epi64x(0xffffc0000))),
+            _mm256_srli_epi64(s, 36));
+    }
+
+    __m256i fliplr(__m256i s)
+    {
+        return _mm256_or_si256(_mm256_or_si256(
+            _mm256_and_si256(_mm256_slli_epi64(s, 12),
+                _mm256_set1_epi64x(0x3f000fc003f000)),
+            _mm256_and_si256(s, _mm256_set1_epi64x(0xfc003f000fc0))),
+            _mm256_and_si256(_mm256_srli_epi64(s, 12),
+                _mm256_set1_epi64x(0x3f000fc003f)));
+    }
+
+    __m256i antitranspose(__m256i s)
+    {
+        return _mm256_or_si256(_mm256_or_si256(_mm256_or_si256(
+            _mm256_and_si256(_mm256_slli_epi64(s, 48),
+                _mm256_set1_epi64x(0x3f000000000000)),
+            _mm256_and_si256(_mm256_slli_epi64(s, 24),
+                _mm256_set1_epi64x(0xfc0fc0000000))),
+            _mm256_or_si256(_mm256_and_si256(s,
+                _mm256_set1_epi64x(0x3f03f03f000)),
+            _mm256_and_si256(_mm256_srli_epi64(s, 24),
+                _mm256_set1_epi64x(0xfc0fc0)))),
+            _mm256_srli_epi64(s, 48));
+    }
+
+    __m256i min(__m256i a, __m256i b)
+    {
+        return _mm256_blendv_epi8(a, b, _mm256_cmpgt_epi64(a, b));
+    }
+#endif
+
+    // Rank game states by the placement of pieces of each size: a placement
+    // is an 18-bit pattern of who (if anyone) has a piece of that size on
+    // each square, and is ranked densely among all placements with at most
+    // num_per_size pieces per player. The largest size is ranked only up to
+    // symmetry, so that rank(s) == rank(t) exactly when s and t are
+    // symmetric, and all states that satisfy piece-count constraints map
+    // into [0, num_ranks).
+
+    // Return pattern of pieces of given size, 2 bits per square.
+    std::uint32_t pattern(State s, int size)
+    {
+        s = (s >> (2 * (size - 1))) & 0x30c30c30c30c3;
+        s = (s | (s >> 4)) & 0xf00f00f00f00f;
+        s = (s | (s >> 8)) & 0xff0000ff0000ff;
+        s = s | (s >> 16);
+        return static_cast<std::uint32_t>(
+            (s & 0xffff) | ((s >> 16) & 0x30000));
+    }
+
+    // Return rank of game state (independent of symmetry).
+    std::size_t rank(State s)
+    {
+        // Only the symmetries that minimize the rank of the largest pieces'
+        // placement need to be considered for the remaining sizes.
+        std::uint32_t orbit =
+            placement_orbit[placement_rank[pattern(s, num_sizes)]];
+        std::size_t min_rest = num_ranks;
+        for (int t = 0; t < 8; ++t)
+        {
+            if ((orbit >> t) & 0x1)
+            {
+                std::size_t rest = 0;
+                for (int size = num_sizes - 1; size >= 1; --size)
+                {
+                    rest = rest * num_placements +
+                        placement_rank[pattern(s, size)];
+                }
+                min_rest = rest < min_rest ? rest : min_rest;
+            }
+            s = (t % 2 == 0 ? flipud(s) : antitranspose(s));
+        }
+        std::size_t r = orbit >> 8;
+        for (int size = 1; size < num_sizes; ++size)
+        {
+            r *= num_placements;
+        }
+        return r + min_rest;
+    }
+
+    // Return a game state of given rank (if any state has it, i.e. if
+    // rank(unrank(r)) == r), with the largest pieces placed as the least
+    // ranked placement in their orbit.
+    State unrank(std::size_t r)
+    {
+        State s = 0;
+        for (int size = 1; size < num_sizes; ++size)
+        {
+            s |= placement_states[r % num_placements] << (2 * (size - 1));
+            r /= num_placements;
+        }
+        return s |
+            placement_states[orbit_placements[r]] << (2 * (num_sizes - 1));
+    }
+
+    // Precompute placement ranks and symmetries for the current rules.
+    void init_rank()
+    {
+        placement_rank.assign(1 << 18, 0);
+        num_placements = 0;
+        placement_states.clear();
+        for (std::uint32_t p = 0; p < (1 << 18); ++p)
+        {
+            int count[4] = { 0 };
+            State s = 0;
+            for (int square = 0; square < 9; ++square)
+            {
+                ++count[(p >> (2 * square)) & 0x3];
+                s |= static_cast<State>((p >> (2 * square)) & 0x3) <<
+                    (6 * square);
+            }
+            if (count[3] == 0 && count[1] <= num_per_size &&
+                count[2] <= num_per_size)
+            {
+                placement_rank[p] = static_cast<std::uint16_t>(
+                    num_placements++);
+                placement_states.push_back(s);
+            }
+        }
+
+        // Number orbits of placements under symmetry, recording for each
+        // placement which symmetries map it to the minimum rank in its orbit.
+        placement_orbit.assign(num_placements, 0);
+        orbit_placements.clear();
+        std::size_t num_orbits = 0;
+        for (std::size_t r = 0; r < num_placements; ++r)
+        {
+            std::uint16_t images[8];
+            std::uint16_t min_image = static_cast<std::uint16_t>(r);
+            State s = placement_states[r];
+            for (int t = 0; t < 8; ++t)
+            {
+                images[t] = placement_rank[pattern(s, 1)];
+                min_image = images[t] < min_image ? images[t] : min_image;
+                s = (t % 2 == 0 ? flipud(s) : antitranspose(s));
+            }
+            if (min_image == r)
+            {
+                placement_orbit[r] = static_cast<std::uint32_t>(
+                    num_orbits++) << 8;
+                orbit_placements.push_back(static_cast<std::uint32_t>(r));
+            }
+            std::uint32_t transforms = 0;
+            for (int t = 0; t < 8; ++t)
+            {
+                transforms |= (images[t] == min_image ? 1u : 0u) << t;
+            }
+            placement_orbit[r] =
+                (placement_orbit[min_image] & ~0xffu) | transforms;
+        }
+        num_ranks = num_orbits;
+        for (int size = 1; size < num_sizes; ++size)
+        {
+            num_ranks *= num_placements;
+        }
+    }
+
+    // Return value for current player if game over, otherwise 0.
+    int get_terminal_value(State s)
+    {
+        GOBBLET_TIME(TIME_TERMINAL);
+        // Lowest bit of each square, and of each square in each line.
+        const State squares = 0x1041041041041;
+        const State lines[8] = {
+            0x1041, 0x41040000, 0x1041000000000,           // rows
+            0x1000040001, 0x40001000040, 0x1000040001000, // columns
+            0x1000001000001, 0x1001001000                 // diagonals
+        };
+
+        // Find owner of top visible piece on each square at once, using
+        // that each 2-bit size field is 00 (empty), 01 or 10 (owner).
+        State p1 = 0;
+        State p2 = 0;
+        for (int size = 0; size < 3; ++size)
+        {
+            State mine = (s >> (2 * size)) & squares;
+            State theirs = (s >> (2 * size + 1)) & squares;
+            State covered = mine | theirs;
+            p1 = mine | (p1 & ~covered);
+            p2 = theirs | (p2 & ~covered);
+        }
+
+        // You win if your opponent "uncovers" your existing 3-in-a-row,
+        // even if they create their own 3-in-a-row in the same move.
+        bool win = false;
+        bool loss = false;
+        for (auto line : lines)
+        {
+            win |= (p1 & line) == line;
+            loss |= (p2 & line) == line;
+        }
+        return win ? 1 : (loss ? -1 : 0);
+    }
+
+    // Squares (as 9-bit masks) with the current player's piece on top, and
+    // that each size of piece could be played or moved onto; and the size of
+    // the top piece on each square.
+    struct Squares { unsigned mine; unsigned accepts[3]; int sizes[9]; };
+
+    Squares get_squares(State s)
+    {
+        Squares squares{};
+        for (int square = 0; square < 9; ++square)
+        {
+            const Stack& stack = STACKS[(s >> (6 * square)) & 0x3f];
+            squares.mine |= (stack.owner == 1 ? 1u : 0u) << square;
+            for (int size = 0; size < 3; ++size)
+            {
+                squares.accepts[size] |=
+                    ((stack.accepts >> size) & 0x1u) << square;
+            }
+            squares.sizes[square] = stack.size;
+        }
+        return squares;
+    }
+
+    // Return possible moves for current player, ignoring whether
+    // get_terminal_value(s) != 0, and optionally the corresponding
+    // (canonical) next states.
+    Moves get_moves(State s, NextStates* next_states = nullptr)
+    {
+        GOBBLET_TIME(TIME_MOVES);
+        Moves candidates;
+        NextStates states;
+        Squares squares = get_squares(s);
+
+        // Try to move pieces already on the board.
+        if (allow_move)
+        {
+            for (unsigned mine = squares.mine; mine != 0; mine &= mine - 1)
+            {
+                int start = std::countr_zero(mine);
+                int size = squares.sizes[start];
+                for (unsigned ends = squares.accepts[size - 1]; ends != 0;
+                    ends &= ends - 1)
+                {
+                    Move m{start, std::countr_zero(ends)};
+                    candidates.push_back(m);
+                    states.push_back(swap(move(s, m)));
+                }
+            }
+        }
+
+        // Try to play new pieces, counting those of each size already played
+        // (including covered ones).
+        for (int size = 1; size <= num_sizes; ++size)
+        {
+            if (std::popcount(s & (0x1041041041041ull << (2 * (size - 1)))) <
+                num_per_size)
+            {
+                for (unsigned ends = squares.accepts[size - 1]; ends != 0;
+                    ends &= ends - 1)
+                {
+                    Move m{-size, std::countr_zero(ends)};
+                    candidates.push_back(m);
+                    states.push_back(swap(move(s, m)));
+                }
+            }
+        }
+
+        // Only list moves distinct up to symmetry.
+        canonical(states.begin(), states.size(), states.begin());
+        Moves moves;
+        std::size_t n = 0;
+        for (std::size_t i = 0; i < candidates.size(); ++i)
+        {
+            if (std::find(states.begin(), states.begin() + n, states[i]) ==
+                states.begin() + n)
+            {
+                moves.push_back(candidates[i]);
+                states[n++] = states[i];
+            }
+        }
+        if (next_states)
+        {
+            states.resize(n);
+            *next_states = states;
+        }
+        return moves;
+    }
+
+    // Return sorted list of "unmoves," or distinct previous states leading to
+    // given state.
+    Unmoves get_unmoves(State s)
+    {
+        GOBBLET_TIME(TIME_UNMOVES);
+        Unmoves unmoves;
+        s = swap(s);
+        Squares squares = get_squares(s);
+        for (unsigned mine = squares.mine; mine != 0; mine &= mine - 1)
+        {
+            int end = std::countr_zero(mine);
+            int size = squares.sizes[end];
+            if (allow_move)
+            {
+                // Try to (un)move piece to previous square.
+                for (unsigned starts = squares.accepts[size - 1]; starts != 0;
+                    starts &= starts - 1)
+                {
+                    State prev = move(s, Move{end, std::countr_zero(starts)});
+
+                    // Verify that the game wasn't already over.
+                    if (get_terminal_value(prev) == 0)
+                    {
+                        unmoves.push_back(prev);
+                    }
+                }
+            }
+
+            // Try to (un)play (i.e., remove) new piece.
+            State prev = move(s, Move{-size, end});
+            if (get_terminal_value(prev) == 0)
+            {
+                unmoves.push_back(prev);
+            }
+        }
+        canonical(unmoves.begin(), unmoves.size(), unmoves.begin());
+        std::sort(unmoves.begin(), unmoves.end());
+        unmoves.resize(std::unique(unmoves.begin(), unmoves.end()) -
+            unmoves.begin());
+        return unmoves;
+    }
+};
+
+// Game with rules chosen at run time, or specialized for given rules.
+typedef BasicGame<> Game;
+template<int NUM_SIZES, int NUM_PER_SIZE, bool ALLOW_MOVE>
+using FixedGame = BasicGame<FixedRules<NUM_SIZES, NUM_PER_SIZE, ALLOW_MOVE> >;
+
+// Call f.template operator()<G>(rules) for each rule variant that gobblet
+// plays, with G the FixedGame specialized for it (e.g., with f a lambda
+// []<typename G>(const Variant& rules) {...}), so that tools can dispatch
+// rules chosen at run time to the specialized game: in order of num_sizes
+// and allow_move, num_per_size = 1, 2, ..., up to 9, limited by the 9
+// squares, or 2 with 3 sizes, for the table to fit.
+template<int NUM_SIZES, bool ALLOW_MOVE, typename F, int... I>
+void for_each_fixed_game(F& f, std::integer_sequence<int, I...>)
+{
+    (f.template operator()<FixedGame<NUM_SIZES, I + 1, ALLOW_MOVE> >(
+        Variant{NUM_SIZES, I + 1, ALLOW_MOVE}), ...);
+}
+
+template<typename F>
+void for_each_fixed_game(F f)
+{
+    for_each_fixed_game<1, false>(f, std::make_integer_sequence<int, 9>{});
+    for_each_fixed_game<1, true>(f, std::make_integer_sequence<int, 9>{});
+    for_each_fixed_game<2, false>(f, std::make_integer_sequence<int, 9>{});
+    for_each_fixed_game<2, true>(f, std::make_integer_sequence<int, 9>{});
+    for_each_fixed_game<3, false>(f, std::make_integer_sequence<int, 2>{});
+    for_each_fixed_game<3, true>(f, std::make_integer_sequence<int, 2>{});
+}
+
+#endif
@@ -0,0 +1,48 @@
+// Convert solved table cache files to packed table files for distribution.
+// Tables written by the original solver, a headerless dump of its 2^29-slot
+// hash map, are converted too, and read back from the packed table to check
+// that none of their entries were lost or changed. With --frozen, a cache
+// file is converted to a frozen table file instead (see Game::freeze()).
+
+#include "gobblet.h"
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+int main(int argc, char** argv)
+{
+    bool frozen = argc > 1 && std::strcmp(argv[1], "--frozen") == 0;
+    if (frozen)
+    {
+        --argc;
+        ++argv;
+    }
+    if (argc != 6)
+    {
+        std::cerr << "Usage: " << argv[0] << " [--frozen] num_sizes " <<
+            "num_per_size allow_move cache_file packed_file" << std::endl;
+        return 1;
+    }
+    Variant rules{std::atoi(argv[1]), std::atoi(argv[2]),
+        std::atoi(argv[3]) != 0};
+    if (rules.num_sizes < 1 || rules.num_sizes > 3 ||
+        rules.num_per_size < 1 ||
+        rules.num_per_size > (rules.num_sizes < 3 ? 9 : 2))
+    {
+        std::cerr << "Rule variant not supported." << std::endl;
+        return 1;
+    }
+    Game game(&std::cout);
+    if (frozen ? !(game.open(rules, argv[4], true) && game.freeze() &&
+        game.save(argv[5])) : !game.convert(rules, argv[4], argv[5]))
+    {
+        std::cerr << "Failed to convert " << argv[4] << std::endl;
+        return 1;
+    }
+    if (!game.open(rules, argv[5], true))
+    {
+        std::cerr << "Failed to verify " << argv[5] << std::endl;
+        return 1;
+    }
+    return 0;
+}
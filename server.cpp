@@ -0,0 +1,332 @@
+// Serve evaluations and best moves for one or more rule variants to many
+// clients at once, over TCP. Each variant's table is loaded (or solved) once
+// at startup, as the game specialized for its rules, and only read after
+// that, so a pool of threads answers requests concurrently without locking.
+// Connections are not tied to threads: the threads all wait on one epoll set
+// of the listening socket and every open connection, each armed for a single
+// event at a time, so whichever thread is free reads the next data to arrive
+// on any connection, answers the complete lines received and rearms it. An
+// idle client thus holds no thread, and one that stops reading its responses
+// is dropped after SEND_TIMEOUT. Each request and response is one line:
+//
+//   evaluate <variant> <state>  ->  <value> <moves>
+//   best <variant> <state>      ->  <start> <end>
+//   moves <variant> <state>     ->  <start> <end> <value> <moves> ...
+//   line <variant> <state>      ->  <start> <end> <value> <moves> ...
+//   canonical <variant> <state> ->  <key> <symmetry>
+//
+// where <variant> is num_sizes_num_per_size_allow_move (e.g. 3_2_1), <state>
+// is a game state in hex, in any orientation, with the player to move as
+// player 1, <value> is 1, 0 or -1 for a win, draw or loss for that player in
+// <moves> moves, and <start> <end> is the best move as entered in play (or
+// 0 0 if the game is over). "moves" lists every move (distinct up to
+// symmetry), best first, and "line" the principal variation, each move
+// followed by the value of the resulting state for the player to move next
+// (so both are empty if the game is over). Each request is answered for the
+// canonical image of its state (computed once per request), the one of its 8
+// images under the symmetries of the board that the table holds, and the
+// moves found on it are mapped back to the orientation the client sent.
+// "canonical" returns that image, in hex, and the symmetry (0 to 7, as
+// numbered in SYMMETRIES) that maps the state to it, so that clients can
+// cache responses by key. A request that cannot be answered gets "error" and
+// the reason instead.
+
+#include "gobblet.h"
+#include <cerrno>
+#include <charconv>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <sys/epoll.h>
+
+// Solved table of a rule variant, answering a command about a game state in
+// hex.
+struct Table
+{
+    std::string variant;
+    std::function<std::string(const std::string&, const std::string&)> respond;
+};
+
+// Open connection, with any partial request line received on it so far.
+struct Connection
+{
+    int fd;
+    std::string buffer;
+};
+
+// Longest request line accepted before the connection is dropped.
+const std::size_t MAX_LINE = 256;
+
+// Seconds a client may leave its responses unread before it is dropped.
+const int SEND_TIMEOUT = 10;
+
+// Return response to command about game state in hex.
+template<typename G>
+std::string respond(G& game, const std::string& command,
+    const std::string& hex)
+{
+    State s = 0;
+    const char* end = hex.data() + hex.size();
+    auto parsed = std::from_chars(hex.data(), end, s, 16);
+    if (parsed.ec != std::errc() || parsed.ptr != end || !game.is_valid(s))
+    {
+        return "error invalid state " + hex;
+    }
+    int symmetry = 0;
+    State key = game.canonical(s, symmetry);
+    if (command == "canonical")
+    {
+        char digits[16];
+        auto printed = std::to_chars(digits, digits + sizeof(digits), key, 16);
+        return std::string(digits, printed.ptr) + " " +
+            std::to_string(symmetry);
+    }
+    Evaluation eval = game.evaluate_canonical(key);
+    if (!eval.found)
+    {
+        return "error unreachable state " + hex;
+    }
+    if (command == "evaluate")
+    {
+        return std::to_string(eval.value) + " " + std::to_string(eval.moves);
+    }
+    if (command == "best")
+    {
+        // Keep the 0 0 of a game that is over, which is no move.
+        Move m = game.best_move(key);
+        if (m.start != 0 || m.end != 0)
+        {
+            m = game.untransform(m, symmetry);
+        }
+        return std::to_string(m.start) + " " + std::to_string(m.end);
+    }
+    if (command == "moves" || command == "line")
+    {
+        std::string out;
+        for (auto& move : command == "moves" ? game.all_move_values(key) :
+            game.principal_variation(key, key))
+        {
+            Move m = game.untransform(move.first, symmetry);
+            out += (out.empty() ? "" : " ") + std::to_string(m.start) + " " +
+                std::to_string(m.end) + " " +
+                std::to_string(move.second.value) + " " +
+                std::to_string(move.second.moves);
+        }
+        return out;
+    }
+    return "error unknown command " + command;
+}
+
+// Return response to one request line.
+std::string respond(std::vector<Table>& tables, const std::string& line)
+{
+    std::istringstream in(line);
+    std::string command, variant, hex;
+    if (!(in >> command >> variant >> hex) || !(in >> std::ws).eof())
+    {
+        return "error expected command, variant and state";
+    }
+    for (auto& table : tables)
+    {
+        if (table.variant == variant)
+        {
+            return table.respond(command, hex);
+        }
+    }
+    return "error unknown variant " + variant;
+}
+
+// Read the data available on given connection, and write the responses to
+// the complete lines received so far, returning false if the client closed
+// the connection or it should be dropped.
+bool serve(std::vector<Table>& tables, Connection& connection)
+{
+    char chunk[4096];
+    ssize_t n = ::recv(connection.fd, chunk, sizeof(chunk), MSG_DONTWAIT);
+    if (n <= 0)
+    {
+        return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK ||
+            errno == EINTR);
+    }
+    std::string& buffer = connection.buffer;
+    buffer.append(chunk, static_cast<std::size_t>(n));
+    std::string out;
+    std::size_t begin = 0;
+    for (std::size_t end; (end = buffer.find('\n', begin)) !=
+        std::string::npos; begin = end + 1)
+    {
+        out += respond(tables, buffer.substr(begin, end - begin)) + "\n";
+    }
+    buffer.erase(0, begin);
+    return Cluster::write_all(connection.fd, out.data(), out.size()) &&
+        buffer.size() <= MAX_LINE;
+}
+
+// Arm (or rearm) given socket of epoll set for one event, with given
+// connection (or nullptr for the listening socket), returning true if
+// successful.
+bool arm(int epoll, int fd, Connection* connection, bool add)
+{
+    epoll_event event{};
+    event.events = EPOLLIN | EPOLLONESHOT;
+    event.data.ptr = connection;
+    return ::epoll_ctl(epoll, add ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, fd,
+        &event) == 0;
+}
+
+// Accept every pending connection on listening socket, adding each to epoll
+// set.
+void accept_all(int epoll, int listener)
+{
+    while (true)
+    {
+        int fd = ::accept(listener, nullptr, nullptr);
+        if (fd < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+            break;
+        }
+        timeval timeout{SEND_TIMEOUT, 0};
+        auto connection = std::make_unique<Connection>(Connection{fd, ""});
+        if (setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout,
+            sizeof(timeout)) == 0 && arm(epoll, fd, connection.get(), true))
+        {
+            connection.release();
+        }
+        else
+        {
+            ::close(fd);
+        }
+    }
+}
+
+// Solve (or load) table of given game specialized for given rules.
+template<typename G>
+bool load(Table& table, const Variant& rules)
+{
+    auto game = std::make_shared<G>(rules.num_sizes, rules.num_per_size,
+        rules.allow_move, &std::cout);
+    table.respond = [game](const std::string& command,
+        const std::string& hex)
+    {
+        return respond(*game, command, hex);
+    };
+    return game->has_table();
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 4)
+    {
+        std::cerr << "Usage: " << argv[0] << " port num_threads " <<
+            "num_sizes_num_per_size_allow_move..." << std::endl;
+        return 1;
+    }
+    std::string port = argv[1];
+    int num_threads = std::atoi(argv[2]);
+    std::vector<Table> tables;
+    for (int arg = 3; arg < argc; ++arg)
+    {
+        int num_sizes = 0;
+        int num_per_size = 0;
+        int allow_move = 0;
+        char extra = 0;
+        if (std::sscanf(argv[arg], "%d_%d_%d%c", &num_sizes, &num_per_size,
+            &allow_move, &extra) != 3 || num_sizes < 1 || num_sizes > 3 ||
+            num_per_size < 1 || num_per_size > (num_sizes < 3 ? 9 : 2) ||
+            allow_move < 0 || allow_move > 1)
+        {
+            std::cerr << "Rule variant " << argv[arg] << " not supported." <<
+                std::endl;
+            return 1;
+        }
+
+        // Every variant accepted above is specialized (see
+        // for_each_fixed_game()).
+        Table table{argv[arg], nullptr};
+        bool solved = false;
+        for_each_fixed_game([&]<typename G>(const Variant& rules)
+        {
+            if (rules.num_sizes == num_sizes &&
+                rules.num_per_size == num_per_size &&
+                rules.allow_move == (allow_move != 0))
+            {
+                solved = load<G>(table, rules);
+            }
+        });
+        if (!solved)
+        {
+            std::cerr << "Failed to solve " << argv[arg] << "." << std::endl;
+            return 1;
+        }
+        tables.push_back(std::move(table));
+    }
+
+    int listener = Cluster::listen(":" + port, SOMAXCONN);
+    int epoll = ::epoll_create1(0);
+    if (listener < 0 || num_threads < 1 || epoll < 0 ||
+        ::fcntl(listener, F_SETFL, O_NONBLOCK) != 0 ||
+        !arm(epoll, listener, nullptr, true))
+    {
+        std::cerr << "Failed to listen on port " << port << " with " <<
+            num_threads << " threads." << std::endl;
+        return 1;
+    }
+    std::cout << "Serving " << tables.size() << " variants on port " << port <<
+        " with " << num_threads << " threads." << std::endl;
+
+    // Each thread handles one event at a time, from the listening socket or
+    // any connection, which is rearmed for the next one once handled (or
+    // closed), so that no two threads ever handle the same connection.
+    std::vector<std::thread> pool;
+    for (int thread = 0; thread < num_threads; ++thread)
+    {
+        pool.emplace_back([&]()
+        {
+            while (true)
+            {
+                epoll_event event{};
+                if (::epoll_wait(epoll, &event, 1, -1) < 0)
+                {
+                    if (errno == EINTR)
+                    {
+                        continue;
+                    }
+                    break;
+                }
+                auto connection = static_cast<Connection*>(event.data.ptr);
+                if (connection == nullptr)
+                {
+                    accept_all(epoll, listener);
+                    arm(epoll, listener, nullptr, false);
+                }
+                else if ((event.events & EPOLLIN) == 0 ||
+                    !serve(tables, *connection) ||
+                    !arm(epoll, connection->fd, connection, false))
+                {
+                    ::epoll_ctl(epoll, EPOLL_CTL_DEL, connection->fd,
+                        nullptr);
+                    ::close(connection->fd);
+                    delete connection;
+                }
+            }
+        });
+    }
+    for (auto& thread : pool)
+    {
+        thread.join();
+    }
+    ::close(epoll);
+    ::close(listener);
+    return 1;
+}
@@ -0,0 +1,67 @@
+// Check a solved table of a rule variant (a cache, packed or frozen table
+// file) for consistency, and optionally compare it with another table of the
+// same variant in any form, e.g. one written by a different solver. Each
+// entry is checked against its next states' entries by all threads at once,
+// so this takes only a fraction of the time to solve the variant, and the
+// first few inconsistencies or differences found are reported.
+
+#include "gobblet.h"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+// Return seconds since start.
+double seconds_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 5 || argc > 6)
+    {
+        std::cerr << "Usage: " << argv[0] << " num_sizes num_per_size " <<
+            "allow_move table [other_table]" << std::endl;
+        return 1;
+    }
+    Variant rules{std::atoi(argv[1]), std::atoi(argv[2]),
+        std::atoi(argv[3]) != 0};
+    if (rules.num_sizes < 1 || rules.num_sizes > 3 ||
+        rules.num_per_size < 1 ||
+        rules.num_per_size > (rules.num_sizes < 3 ? 9 : 2))
+    {
+        std::cerr << "Rule variant not supported." << std::endl;
+        return 1;
+    }
+    auto start = std::chrono::steady_clock::now();
+    Game game(&std::cerr);
+    if (!game.open(rules, argv[4], true))
+    {
+        std::cerr << "Failed to open " << argv[4] << "." << std::endl;
+        return 1;
+    }
+    std::size_t count = 0;
+    std::size_t bad = game.validate(&count);
+    std::cout << "Checked " << count << " states of " << argv[4] << " in " <<
+        seconds_since(start) << " s: " << bad << " inconsistent." <<
+        std::endl;
+
+    if (argc > 5)
+    {
+        start = std::chrono::steady_clock::now();
+        Game other(&std::cerr);
+        if (!other.open(rules, argv[5], true))
+        {
+            std::cerr << "Failed to open " << argv[5] << "." << std::endl;
+            return 1;
+        }
+        std::size_t differences = game.compare(other, &count);
+        std::cout << "Compared " << count << " states with " << argv[5] <<
+            " in " << seconds_since(start) << " s: " << differences <<
+            " different." << std::endl;
+        bad += differences;
+    }
+    return bad == 0 ? 0 : 1;
+}